@@ -0,0 +1,64 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "benchmark.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+namespace ncnn {
+
+double get_current_time()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER pc;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&pc);
+
+    return pc.QuadPart * 1000.0 / freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
+
+#if NCNN_BENCHMARK
+static thread_local double time_begin = 0.0;
+static thread_local int time_count = 0;
+
+void log_time_begin()
+{
+    time_begin = get_current_time();
+}
+
+void log_time_end(const char* tag)
+{
+    double elapsed = get_current_time() - time_begin;
+    NCNN_LOGE("[%d-%s]\telapsed: %.2fms", time_count, tag, elapsed);
+    time_count++;
+}
+
+void log_time_reset()
+{
+    time_count = 0;
+}
+#endif // NCNN_BENCHMARK
+
+} // namespace ncnn
@@ -0,0 +1,40 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_BENCHMARK_H
+#define NCNN_BENCHMARK_H
+
+#include "platform.h"
+
+namespace ncnn {
+
+// get now timestamp in ms
+double get_current_time();
+
+#if NCNN_BENCHMARK
+// per thread timer around a layer forward, printed with NCNN_LOGE
+// concurrent extractors each keep their own begin timestamp
+void log_time_begin();
+void log_time_end(const char* tag);
+// restart the layer counter, called at each extract
+void log_time_reset();
+#else
+inline void log_time_begin() {}
+inline void log_time_end(const char* /*tag*/) {}
+inline void log_time_reset() {}
+#endif // NCNN_BENCHMARK
+
+} // namespace ncnn
+
+#endif // NCNN_BENCHMARK_H
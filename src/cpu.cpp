@@ -436,7 +436,9 @@ int set_cpu_powersave(int powersave)
 int get_omp_num_threads()
 {
 #ifdef _OPENMP
-    return omp_get_num_threads();
+    // the count the next parallel region would use, as set_omp_num_threads
+    // sets it, omp_get_num_threads is 1 outside of one
+    return omp_get_max_threads();
 #else
     return 1;
 #endif
@@ -23,6 +23,8 @@ Layer::Layer()
 {
     one_blob_only = false;
     support_inplace = false;
+    support_stateful = false;
+    typeindex = -1;
 }
 
 Layer::~Layer()
@@ -84,11 +86,77 @@ int Layer::forward_inplace(Mat& bottom_top_blob) const
     return ret;
 }
 
+int Layer::forward_stateful(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, std::vector<Mat>& /*states*/) const
+{
+    return forward(bottom_blobs, top_blobs);
+}
+
+int Layer::forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                          const float* mean_vals, const float* norm_vals, Mat& top_blob) const
+{
+    Mat bottom_blob = Mat::from_pixels(pixels, type, w, h);
+    if (bottom_blob.empty())
+        return -100;
+
+    if (mean_vals || norm_vals)
+        bottom_blob.substract_mean_normalize(mean_vals, norm_vals);
+
+    return forward(bottom_blob, top_blob);
+}
+
+int Layer::forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    top_blobs.resize(bottom_blobs.size());
+    for (size_t i=0; i<bottom_blobs.size(); i++)
+    {
+        int ret = forward(bottom_blobs[i], top_blobs[i]);
+        if (ret != 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+int Layer::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.empty())
+        return -1;
+
+    for (size_t i=0; i<top_shapes.size(); i++)
+    {
+        top_shapes[i] = bottom_shapes[0];
+    }
+
+    return 0;
+}
+
+int Layer::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    top_shape = bottom_shape;
+
+    return 0;
+}
+
 #if NCNN_CNNCACHE
 int Layer::forward_mrect(std::vector<MRect>& bottom_mrects, std::vector<MRect>& top_mrects) const
 {
+    // tops change wherever any bottom does
+    MRect merged;
+    merged.copyFrom(bottom_mrects[0]);
+    for (size_t i = 1; i < bottom_mrects.size(); i++) {
+        const MRect& m = bottom_mrects[i];
+        if (m.x_offset != merged.x_offset || m.y_offset != merged.y_offset || m.affine != merged.affine) {
+            // bottoms moved differently, nothing lines up with the cache
+            merged.add_rect(0, 0, MRECT_FULL, MRECT_FULL);
+        }
+        merged.changed_vecs.insert(merged.changed_vecs.end(), m.changed_vecs.begin(), m.changed_vecs.end());
+        merged.matched_vecs.insert(merged.matched_vecs.end(), m.matched_vecs.begin(), m.matched_vecs.end());
+    }
     for (MRect& mrect: top_mrects) {
-        mrect.copyFrom(bottom_mrects[0]);
+        mrect.copyFrom(merged);
     }
     return 0;
 }
@@ -102,6 +170,10 @@ int Layer::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, M
     // LOGI("forward_cached\n");
     return forward(bottom_blob, top_blob);
 }
+int Layer::forward_cached(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, MRect& /*mrect*/, Mat& /*cached_blob*/) const
+{
+    return forward(bottom_blobs, top_blobs);
+}
 #endif
 
 #include "layer_declaration.h"
@@ -15,13 +15,10 @@
 #ifndef NCNN_LAYER_H
 #define NCNN_LAYER_H
 
-#if NCNN_CNNCACHE
-#include <android/log.h>
-#endif
-
 #include <stdio.h>
 #include <string>
 #include <vector>
+#include "benchmark.h"
 #include "mat.h"
 #include "platform.h"
 #include "mrect.h"
@@ -68,6 +65,9 @@ public:
     // support inplace inference
     bool support_inplace;
 
+    // carry recurrent state across calls through forward_stateful
+    bool support_stateful;
+
 public:
     // implement inference
     // return 0 if success
@@ -79,14 +79,45 @@ public:
     virtual int forward_inplace(std::vector<Mat>& bottom_top_blobs) const;
     virtual int forward_inplace(Mat& bottom_top_blob) const;
 
+    // implement inference carrying recurrent state across calls
+    // states is owned by the caller, empty means starting from zero state
+    // return 0 if success
+    virtual int forward_stateful(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, std::vector<Mat>& states) const;
+
+    // implement inference straight from interleaved 8-bit pixels
+    // type as Mat::from_pixels, mean_vals and norm_vals as
+    // Mat::substract_mean_normalize and either may be null
+    // return 0 if success
+    virtual int forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                               const float* mean_vals, const float* norm_vals, Mat& top_blob) const;
+
+    // implement inference of a one blob layer over a batch, one bottom
+    // and one top per sample, layers with weights override it to load
+    // them once for the whole batch, the default runs forward per sample
+    // return 0 if success
+    virtual int forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
+
+    // output shapes for the given input shapes without running forward
+    // the default keeps the shape of the first bottom as elementwise layers do
+    // return 0 if success, -1 when the shape depends on the data
+    virtual int infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const;
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
 #if NCNN_CNNCACHE
     virtual int forward_mrect(std::vector<MRect>& bottom_mrects, std::vector<MRect>& top_mrects) const;
     virtual int forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const;
     virtual int forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const;
+    // cached forward of a multi-input layer with a single top
+    virtual int forward_cached(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, MRect& mrect, Mat& cached_blob) const;
     virtual bool needs_cache() const {return false;}
+    // input window of one output pixel for sliding window layers
+    // false when the layer has no fixed geometry
+    virtual bool input_window(int& /*kernel_extent*/, int& /*stride*/, int& /*pad*/) const {return false;}
 #endif
 
 public:
+    // layer type index as in the param file, custom layers carry CustomBit
+    int typeindex;
 #if NCNN_STRING
     // layer type name
     std::string type;
@@ -105,4 +105,14 @@ int ArgMax::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int ArgMax::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    top_shape = MatShape(topk, out_max_val ? 2 : 1);
+
+    return 0;
+}
+
 } // namespace ncnn
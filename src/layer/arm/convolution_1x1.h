@@ -29,8 +29,7 @@ static void conv1x1s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -261,7 +260,7 @@ static void conv1x1s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -280,8 +279,7 @@ static void conv1x1s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -538,7 +536,7 @@ static void conv1x1s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -558,8 +556,7 @@ static void conv1x1s1_neon_cached(
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -790,7 +787,7 @@ static void conv1x1s1_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 
@@ -810,8 +807,7 @@ static void conv1x1s2_neon_cached(
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -1068,7 +1064,7 @@ static void conv1x1s2_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 #endif // NCNN_CNNCACHE
\ No newline at end of file
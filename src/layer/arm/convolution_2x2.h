@@ -29,8 +29,7 @@ static void conv2x2s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -376,7 +375,7 @@ static void conv2x2s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -396,8 +395,7 @@ static void conv2x2s1_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -748,7 +746,7 @@ static void conv2x2s1_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 #endif // NCNN_CNNCACHE
\ No newline at end of file
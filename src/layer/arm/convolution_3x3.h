@@ -29,8 +29,7 @@ static void conv3x3s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -514,7 +513,7 @@ static void conv3x3s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
 
             kernel0 += 9;
         }
-    }
+    });
 
 }
 
@@ -533,8 +532,7 @@ static void conv3x3s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -749,7 +747,7 @@ static void conv3x3s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
 
             kernel0 += 9;
         }
-    }
+    });
 }
 
 
@@ -769,8 +767,7 @@ static void conv3x3s1_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -1259,7 +1256,7 @@ static void conv3x3s1_neon_cached(
 
             kernel0 += 9;
         }
-    }
+    });
 
 }
 
@@ -1279,8 +1276,7 @@ static void conv3x3s2_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -1495,6 +1491,6 @@ static void conv3x3s2_neon_cached(
 
             kernel0 += 9;
         }
-    }
+    });
 }
 #endif // NCNN_CNNCACHE
\ No newline at end of file
@@ -31,8 +31,7 @@ static void conv4x4s4_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -342,7 +341,7 @@ static void conv4x4s4_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -364,8 +363,7 @@ static void conv4x4s4_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -677,7 +675,7 @@ static void conv4x4s4_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 #endif // NCNN_CNNCACHE
\ No newline at end of file
@@ -29,8 +29,7 @@ static void conv5x5s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -852,7 +851,7 @@ static void conv5x5s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -871,8 +870,7 @@ static void conv5x5s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -1246,7 +1244,7 @@ static void conv5x5s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -1266,8 +1264,7 @@ static void conv5x5s1_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -2095,7 +2092,7 @@ static void conv5x5s1_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 
@@ -2115,8 +2112,7 @@ static void conv5x5s2_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -2492,7 +2488,7 @@ static void conv5x5s2_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 #endif // NCNN_CNNCACHE
\ No newline at end of file
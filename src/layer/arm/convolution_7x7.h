@@ -29,8 +29,7 @@ static void conv7x7s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -537,7 +536,7 @@ static void conv7x7s1_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -556,8 +555,7 @@ static void conv7x7s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
     const float* kernel = _kernel;
     const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -1068,7 +1066,7 @@ static void conv7x7s2_neon(const Mat& bottom_blob, Mat& top_blob, const Mat& _ke
             }
 
         }
-    }
+    });
 
 }
 
@@ -1089,8 +1087,7 @@ static void conv7x7s1_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -1599,7 +1596,7 @@ static void conv7x7s1_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 
@@ -1619,8 +1616,7 @@ static void conv7x7s2_neon_cached(
     const float* kernel = _kernel;
     // const float* bias = _bias;
 
-    #pragma omp parallel for
-    for (int p=0; p<outch; p++)
+    parallel_for(0, outch, [&](int p)
     {
         Mat out = top_blob.channel(p);
 
@@ -2133,7 +2129,7 @@ static void conv7x7s2_neon_cached(
             }
 
         }
-    }
+    });
 
 }
 #endif // NCNN_CNNCACHE
\ No newline at end of file
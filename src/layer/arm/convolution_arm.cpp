@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "convolution_arm.h"
+#include "threadpool.h"
 
 namespace ncnn {
 
@@ -22,9 +23,19 @@ namespace ncnn {
 #include "convolution_4x4.h"
 #include "convolution_5x5.h"
 #include "convolution_7x7.h"
+#include "convolution_pixels.h"
 
 DEFINE_LAYER_CREATOR(Convolution_arm)
 
+int Convolution_arm::forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                                    const float* mean_vals, const float* norm_vals, Mat& top_blob) const
+{
+    if (!support_pixels(type))
+        return Layer::forward_pixels(pixels, type, w, h, mean_vals, norm_vals, top_blob);
+
+    return forward_pixels_s2(pixels, type, w, h, mean_vals, norm_vals, top_blob, conv_phase_rows_neon);
+}
+
 int Convolution_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
 {
     // convolv with NxN kernel
@@ -124,15 +135,14 @@ int Convolution_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
     int outw = (w - kernel_size) / stride + 1;
     int outh = (h - kernel_size) / stride + 1;
 
-    LOGI("Convolution_arm::forward input=%dx%dx%d pad=%d ksize=%d output=%d stride=%d\n",
-        bottom_blob.w, bottom_blob.h, channels, pad, kernel_size, num_output, stride);
-
     top_blob.create(outw, outh, num_output);
     if (top_blob.empty())
         return -100;
 
     conv(bottom_blob_bordered, top_blob, weight_data, bias_data);
 
+    activate(top_blob);
+
     log_time_end("conv_arm");
 
     return 0;
@@ -264,7 +274,7 @@ int Convolution_arm::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect
     if (top_blob.empty())
         return -100;
 
-    if (mrect.size() == 0) {
+    if (mrect.size() == 0 && !mrect.affine) {
         memcpy(top_blob.data, cached_blob.data, cached_blob.total() * sizeof(float));
         log_time_end("conv_arm_cached");
         return 0;
@@ -277,28 +287,31 @@ int Convolution_arm::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect
     // Construct cached map
     bool* cached_map = (bool*) calloc(outh * outw, sizeof(bool));
     int mrect_size = mrect.size();
-    #pragma omp parallel for
-    for (int i = 0; i < mrect_size; i ++) {
+    parallel_for(0, mrect_size, [&](int i) {
         struct rect r = mrect.changed_vecs[i];
         for (int h = r.y1; h <= std::min(r.y2, outh - 1); h ++)
             for (int w = r.x1; w <= std::min(r.x2, outw - 1); w ++)
                 cached_map[h * outw + w] = true;
-    }
+    });
 
     if (skip_reuse(cached_map, outh, outw)) {
         free(cached_map);
         return Convolution_arm::forward(bottom_blob, top_blob);
     }
 
+    // Resample the cache under affine motion, it may flag more pixels
+    if (mrect.affine) {
+        mrect.warp_cached(cached_blob, top_blob, cached_map);
+    }
+
     // Reuse cache
     // TODO: move it to neon to save time
     const int cpy_size = (outw - abs(mrect.x_offset)) * sizeof(float);
     const int sh = (mrect.y_offset >= 0 ? 0 : -mrect.y_offset);
     const int eh = (mrect.y_offset >= 0 ? (outh - mrect.y_offset) : outh);
     const int sw = (mrect.x_offset >= 0 ? 0 : -mrect.x_offset);
-    #pragma omp parallel for
-    for (int i = 0; i < num_output; i ++) {
-        for (int h = sh; h < eh; h ++) {
+    parallel_for(0, num_output, [&](int i) {
+        for (int h = sh; h < eh && !mrect.affine; h ++) {
             float* dst = top_blob.channel(i).row(h) + sw;
             float* src = cached_blob.channel(i).row(h + mrect.y_offset) + sw + mrect.x_offset;
             memcpy(dst, src, cpy_size);
@@ -316,10 +329,12 @@ int Convolution_arm::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect
             flag ++;
             data ++;
         }
-    }
+    });
 
     conv(bottom_blob_bordered, top_blob, weight_data, bias_data, cached_map);
 
+    activate(top_blob, cached_map);
+
     log_time_end("conv_arm_cached");
 
     free(cached_map);
@@ -23,6 +23,9 @@ class Convolution_arm : public Convolution
 {
 public:
     virtual int forward(const Mat& bottom_blobs, Mat& top_blobs) const;
+
+    virtual int forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                               const float* mean_vals, const float* norm_vals, Mat& top_blob) const;
 #if NCNN_CNNCACHE
     virtual bool needs_cache() const {return true;}
     virtual int forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const;
@@ -0,0 +1,83 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if __ARM_NEON
+#include <arm_neon.h>
+#endif // __ARM_NEON
+
+// stride 2 stem on the phase rows of Convolution::pixels_to_phase_rows
+// eight outputs per step stay in registers across all taps
+static void conv_phase_rows_neon(const float* band, int band_rows, int phase_w, Mat& top_blob,
+                                 int oy0, int orows, const Mat& _kernel, const Mat& _bias, int kernel_size)
+{
+    const int outw = top_blob.w;
+    const int outch = top_blob.c;
+    const int maxk = kernel_size * kernel_size;
+    const int tap_count = 3 * maxk;
+    const int row_size = phase_w * 2;
+    const int channel_size = band_rows * row_size;
+
+    std::vector<int> _tap_ofs(tap_count);
+    int* tap_ofs = &_tap_ofs[0];
+    for (int q = 0; q < 3; q++)
+    {
+        for (int ky = 0; ky < kernel_size; ky++)
+        {
+            for (int kx = 0; kx < kernel_size; kx++)
+                tap_ofs[q * maxk + ky * kernel_size + kx] = q * channel_size + ky * row_size + (kx & 1) * phase_w + (kx >> 1);
+        }
+    }
+
+    const float* kernel = _kernel;
+    const float* bias = _bias;
+
+    for (int p = 0; p < outch; p++)
+    {
+        const float* kptr = kernel + p * tap_count;
+        const float bias0 = bias ? bias[p] : 0.f;
+
+        for (int r = 0; r < orows; r++)
+        {
+            const float* rowptr = band + 2 * r * row_size;
+            float* outptr = top_blob.channel(p).row(oy0 + r);
+
+            int x = 0;
+#if __ARM_NEON
+            for (; x + 7 < outw; x += 8)
+            {
+                float32x4_t _sum0 = vdupq_n_f32(bias0);
+                float32x4_t _sum1 = vdupq_n_f32(bias0);
+
+                for (int k = 0; k < tap_count; k++)
+                {
+                    const float* sptr = rowptr + tap_ofs[k] + x;
+                    _sum0 = vmlaq_n_f32(_sum0, vld1q_f32(sptr), kptr[k]);
+                    _sum1 = vmlaq_n_f32(_sum1, vld1q_f32(sptr + 4), kptr[k]);
+                }
+
+                vst1q_f32(outptr + x, _sum0);
+                vst1q_f32(outptr + x + 4, _sum1);
+            }
+#endif // __ARM_NEON
+            for (; x < outw; x++)
+            {
+                float sum = bias0;
+                for (int k = 0; k < tap_count; k++)
+                    sum += kptr[k] * rowptr[tap_ofs[k] + x];
+
+                outptr[x] = sum;
+            }
+        }
+    }
+}
@@ -0,0 +1,227 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if NCNN_CNNCACHE
+// depth-wise kernels for the cached path
+// only the dirty spans of each row are computed, true in cached_map means recompute
+static void convdw3x3s1_neon_cached(const Mat& bottom_blob, Mat& top_blob, const Mat& _kernel, const Mat& _bias, const bool* cached_map)
+{
+    int w = bottom_blob.w;
+
+    int outw = top_blob.w;
+    int outh = top_blob.h;
+
+    const int group = bottom_blob.c;
+
+    const float* kernel = _kernel;
+    const float* bias = _bias;
+
+    #pragma omp parallel for
+    for (int g=0; g<group; g++)
+    {
+        Mat out = top_blob.channel(g);
+
+        const float bias0 = bias ? bias[g] : 0.f;
+
+        const float* kernel0 = kernel + g*9;
+
+        const float* img0 = bottom_blob.channel(g);
+
+#if __ARM_NEON
+        float32x4_t _k012x = vld1q_f32(kernel0);
+        float32x4_t _k345x = vld1q_f32(kernel0 + 3);
+        float32x4_t _k678x = vld1q_f32(kernel0 + 5);
+        _k678x = vextq_f32(_k678x, _k678x, 1);
+        float32x4_t _bias0 = vdupq_n_f32(bias0);
+#endif // __ARM_NEON
+
+        for (int i = 0; i < outh; i++)
+        {
+            float* outptr = out.row(i);
+            const bool* flag = cached_map + i * outw;
+
+            const float* r0 = img0 + w * i;
+            const float* r1 = r0 + w;
+            const float* r2 = r1 + w;
+
+            int j = 0;
+            while (j < outw)
+            {
+                if (!flag[j])
+                {
+                    j++;
+                    continue;
+                }
+
+                int end = j + 1;
+                while (end < outw && flag[end])
+                    end++;
+
+#if __ARM_NEON
+                for (; j + 3 < end; j += 4)
+                {
+                    float32x4_t _r00 = vld1q_f32(r0 + j);
+                    float32x4_t _r01 = vld1q_f32(r0 + j + 1);
+                    float32x4_t _r02 = vld1q_f32(r0 + j + 2);
+
+                    float32x4_t _r10 = vld1q_f32(r1 + j);
+                    float32x4_t _r11 = vld1q_f32(r1 + j + 1);
+                    float32x4_t _r12 = vld1q_f32(r1 + j + 2);
+
+                    float32x4_t _r20 = vld1q_f32(r2 + j);
+                    float32x4_t _r21 = vld1q_f32(r2 + j + 1);
+                    float32x4_t _r22 = vld1q_f32(r2 + j + 2);
+
+                    float32x4_t _sum = _bias0;
+
+                    _sum = vmlaq_lane_f32(_sum, _r00, vget_low_f32(_k012x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r01, vget_low_f32(_k012x), 1);
+                    _sum = vmlaq_lane_f32(_sum, _r02, vget_high_f32(_k012x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r10, vget_low_f32(_k345x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r11, vget_low_f32(_k345x), 1);
+                    _sum = vmlaq_lane_f32(_sum, _r12, vget_high_f32(_k345x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r20, vget_low_f32(_k678x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r21, vget_low_f32(_k678x), 1);
+                    _sum = vmlaq_lane_f32(_sum, _r22, vget_high_f32(_k678x), 0);
+
+                    vst1q_f32(outptr + j, _sum);
+                }
+#endif // __ARM_NEON
+                for (; j < end; j++)
+                {
+                    float sum = bias0;
+
+                    sum += r0[j] * kernel0[0];
+                    sum += r0[j + 1] * kernel0[1];
+                    sum += r0[j + 2] * kernel0[2];
+                    sum += r1[j] * kernel0[3];
+                    sum += r1[j + 1] * kernel0[4];
+                    sum += r1[j + 2] * kernel0[5];
+                    sum += r2[j] * kernel0[6];
+                    sum += r2[j + 1] * kernel0[7];
+                    sum += r2[j + 2] * kernel0[8];
+
+                    outptr[j] = sum;
+                }
+            }
+        }
+    }
+}
+
+static void convdw3x3s2_neon_cached(const Mat& bottom_blob, Mat& top_blob, const Mat& _kernel, const Mat& _bias, const bool* cached_map)
+{
+    int w = bottom_blob.w;
+
+    int outw = top_blob.w;
+    int outh = top_blob.h;
+
+    const int group = bottom_blob.c;
+
+    const float* kernel = _kernel;
+    const float* bias = _bias;
+
+    #pragma omp parallel for
+    for (int g=0; g<group; g++)
+    {
+        Mat out = top_blob.channel(g);
+
+        const float bias0 = bias ? bias[g] : 0.f;
+
+        const float* kernel0 = kernel + g*9;
+
+        const float* img0 = bottom_blob.channel(g);
+
+#if __ARM_NEON
+        float32x4_t _k012x = vld1q_f32(kernel0);
+        float32x4_t _k345x = vld1q_f32(kernel0 + 3);
+        float32x4_t _k678x = vld1q_f32(kernel0 + 5);
+        _k678x = vextq_f32(_k678x, _k678x, 1);
+        float32x4_t _bias0 = vdupq_n_f32(bias0);
+#endif // __ARM_NEON
+
+        for (int i = 0; i < outh; i++)
+        {
+            float* outptr = out.row(i);
+            const bool* flag = cached_map + i * outw;
+
+            const float* r0 = img0 + w * i * 2;
+            const float* r1 = r0 + w;
+            const float* r2 = r1 + w;
+
+            int j = 0;
+            while (j < outw)
+            {
+                if (!flag[j])
+                {
+                    j++;
+                    continue;
+                }
+
+                int end = j + 1;
+                while (end < outw && flag[end])
+                    end++;
+
+#if __ARM_NEON
+                for (; j + 3 < end; j += 4)
+                {
+                    // val[0] p0 p2 p4 p6  val[1] p1 p3 p5 p7
+                    float32x4x2_t _r0 = vld2q_f32(r0 + j * 2);
+                    float32x4_t _r02 = vextq_f32(_r0.val[0], vdupq_n_f32(r0[j * 2 + 8]), 1);
+
+                    float32x4x2_t _r1 = vld2q_f32(r1 + j * 2);
+                    float32x4_t _r12 = vextq_f32(_r1.val[0], vdupq_n_f32(r1[j * 2 + 8]), 1);
+
+                    float32x4x2_t _r2 = vld2q_f32(r2 + j * 2);
+                    float32x4_t _r22 = vextq_f32(_r2.val[0], vdupq_n_f32(r2[j * 2 + 8]), 1);
+
+                    float32x4_t _sum = _bias0;
+
+                    _sum = vmlaq_lane_f32(_sum, _r0.val[0], vget_low_f32(_k012x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r0.val[1], vget_low_f32(_k012x), 1);
+                    _sum = vmlaq_lane_f32(_sum, _r02, vget_high_f32(_k012x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r1.val[0], vget_low_f32(_k345x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r1.val[1], vget_low_f32(_k345x), 1);
+                    _sum = vmlaq_lane_f32(_sum, _r12, vget_high_f32(_k345x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r2.val[0], vget_low_f32(_k678x), 0);
+                    _sum = vmlaq_lane_f32(_sum, _r2.val[1], vget_low_f32(_k678x), 1);
+                    _sum = vmlaq_lane_f32(_sum, _r22, vget_high_f32(_k678x), 0);
+
+                    vst1q_f32(outptr + j, _sum);
+                }
+#endif // __ARM_NEON
+                for (; j < end; j++)
+                {
+                    const float* p0 = r0 + j * 2;
+                    const float* p1 = r1 + j * 2;
+                    const float* p2 = r2 + j * 2;
+
+                    float sum = bias0;
+
+                    sum += p0[0] * kernel0[0];
+                    sum += p0[1] * kernel0[1];
+                    sum += p0[2] * kernel0[2];
+                    sum += p1[0] * kernel0[3];
+                    sum += p1[1] * kernel0[4];
+                    sum += p1[2] * kernel0[5];
+                    sum += p2[0] * kernel0[6];
+                    sum += p2[1] * kernel0[7];
+                    sum += p2[2] * kernel0[8];
+
+                    outptr[j] = sum;
+                }
+            }
+        }
+    }
+}
+#endif // NCNN_CNNCACHE
@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "convolutiondepthwise_arm.h"
+#include "threadpool.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -26,6 +27,7 @@ namespace ncnn {
 #include "convolution_4x4.h"
 #include "convolution_5x5.h"
 #include "convolution_7x7.h"
+#include "convolutiondepthwise_3x3.h"
 
 DEFINE_LAYER_CREATOR(ConvolutionDepthWise_arm)
 
@@ -128,9 +130,6 @@ int ConvolutionDepthWise_arm::forward(const Mat& bottom_blob, Mat& top_blob) con
     int outw = (w - kernel_size) / stride + 1;
     int outh = (h - kernel_size) / stride + 1;
 
-    LOGI("ConvolutionDepthWise_arm::forward_cached input=%dx%dx%d pad=%d ksize=%d output=%d stride=%d\n",
-        bottom_blob.w, bottom_blob.h, channels, pad, kernel_size, num_output, stride);
-
     top_blob.create(outw, outh, num_output);
     if (top_blob.empty())
         return -100;
@@ -161,6 +160,8 @@ int ConvolutionDepthWise_arm::forward(const Mat& bottom_blob, Mat& top_blob) con
 #ifdef _OPENMP
         omp_set_nested(nested_current);
 #endif
+        activate(top_blob);
+
         return 0;
     }
 
@@ -179,6 +180,8 @@ int ConvolutionDepthWise_arm::forward(const Mat& bottom_blob, Mat& top_blob) con
         conv(bottom_blob_bordered_g, top_blob_g, weight_data_g, bias_data_g);
     }
 
+    activate(top_blob);
+
     log_time_end("convdepthwise_arm");
 
     return 0;
@@ -192,6 +195,36 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
         return ConvolutionDepthWise::forward_cached(bottom_blob, top_blob, mrect, cached_blob);
     }
 
+    // depth-wise 3x3 computes the dirty spans only
+    if (kernel_size == 3 && (stride == 1 || stride == 2)
+        && bottom_blob.c == group && group == num_output && !cached_blob.empty())
+    {
+        log_time_begin();
+
+        Mat bottom_blob_bordered;
+        bool* cached_map;
+        int ret = prepare_cached(bottom_blob, bottom_blob_bordered, top_blob, mrect, cached_blob, cached_map);
+        if (ret == 1)
+            return 0;
+        if (ret == 2)
+            return ConvolutionDepthWise_arm::forward(bottom_blob, top_blob);
+        if (ret != 0)
+            return ret;
+
+        if (stride == 1)
+            convdw3x3s1_neon_cached(bottom_blob_bordered, top_blob, weight_data, bias_data, cached_map);
+        else
+            convdw3x3s2_neon_cached(bottom_blob_bordered, top_blob, weight_data, bias_data, cached_map);
+
+        activate(top_blob, cached_map);
+
+        free(cached_map);
+
+        log_time_end("convdepthwise_arm_cached");
+
+        return 0;
+    }
+
     log_time_begin();
 
     typedef void (*conv_func)(const Mat&, Mat&, const Mat&, const Mat&, bool*);
@@ -246,7 +279,7 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
     conv_func conv = conv_func_table[kernel_size-1][stride-1];
     if (!conv)
     {
-        return ConvolutionDepthWise::forward(bottom_blob, top_blob);
+        return ConvolutionDepthWise::forward_cached(bottom_blob, top_blob, mrect, cached_blob);
     }
 
     int w = bottom_blob.w;
@@ -293,9 +326,6 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
         ++ itr;
     }
 
-    LOGI("ConvolutionDepthWise_arm::forward_cached input=%dx%dx%d pad=%d ksize=%d output=%d stride=%d\n",
-        bottom_blob.w, bottom_blob.h, channels, pad, kernel_size, num_output, stride);
-
     top_blob.create(outw, outh, num_output);
     if (top_blob.empty())
         return -100;
@@ -316,6 +346,11 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
         return ConvolutionDepthWise_arm::forward(bottom_blob, top_blob);
     }
 
+    // Resample the cache under affine motion, it may flag more pixels
+    if (mrect.affine) {
+        mrect.warp_cached(cached_blob, top_blob, cached_map);
+    }
+
     // Reuse cache
     // TODO: move it to neon to save time
     const int cpy_size = (outw - abs(mrect.x_offset)) * sizeof(float);
@@ -324,7 +359,7 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
     const int sw = (mrect.x_offset >= 0 ? 0 : -mrect.x_offset);
     #pragma omp parallel for
     for (int i = 0; i < num_output; i ++) {
-        for (int h = sh; h < eh; h ++) {
+        for (int h = sh; h < eh && !mrect.affine; h ++) {
             float* dst = top_blob.channel(i).row(h) + sw;
             float* src = cached_blob.channel(i).row(h + mrect.y_offset) + sw + mrect.x_offset;
             memcpy(dst, src, cpy_size);
@@ -370,6 +405,12 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
 #ifdef _OPENMP
         omp_set_nested(nested_current);
 #endif
+        activate(top_blob, cached_map);
+
+        free(cached_map);
+
+        log_time_end("convdepthwise_arm_cached");
+
         return 0;
     }
 
@@ -388,6 +429,8 @@ int ConvolutionDepthWise_arm::forward_cached(const Mat& bottom_blob, Mat& top_bl
         conv(bottom_blob_bordered_g, top_blob_g, weight_data_g, bias_data_g, cached_map);
     }
 
+    activate(top_blob, cached_map);
+
     log_time_end("convdepthwise_arm_cached");
 
     free(cached_map);
@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "eltwise_arm.h"
+#include "threadpool.h"
 
 #if __ARM_NEON
 #include <arm_neon.h>
@@ -39,8 +40,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
     {
         // first blob
         const Mat& bottom_blob1 = bottom_blobs[1];
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             const float* ptr1 = bottom_blob1.channel(q);
@@ -100,13 +100,12 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                 ptr1++;
                 outptr++;
             }
-        }
+        });
 
         for (size_t b=2; b<bottom_blobs.size(); b++)
         {
             const Mat& bottom_blob1 = bottom_blobs[b];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob1.channel(q);
                 float* outptr = top_blob.channel(q);
@@ -161,7 +160,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                     ptr++;
                     outptr++;
                 }
-            }
+            });
         }
     }
     else if (op_type == Operation_SUM)
@@ -170,8 +169,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
         {
             // first blob
             const Mat& bottom_blob1 = bottom_blobs[1];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob.channel(q);
                 const float* ptr1 = bottom_blob1.channel(q);
@@ -231,13 +229,12 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                     ptr1++;
                     outptr++;
                 }
-            }
+            });
 
             for (size_t b=2; b<bottom_blobs.size(); b++)
             {
                 const Mat& bottom_blob1 = bottom_blobs[b];
-                #pragma omp parallel for
-                for (int q=0; q<channels; q++)
+                parallel_for(0, channels, [&](int q)
                 {
                     const float* ptr = bottom_blob1.channel(q);
                     float* outptr = top_blob.channel(q);
@@ -292,7 +289,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                         ptr++;
                         outptr++;
                     }
-                }
+                });
             }
         }
         else
@@ -303,8 +300,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
             const Mat& bottom_blob1 = bottom_blobs[1];
             float coeff0 = coeffs_ptr[0];
             float coeff1 = coeffs_ptr[1];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob.channel(q);
                 const float* ptr1 = bottom_blob1.channel(q);
@@ -370,14 +366,13 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                     ptr1++;
                     outptr++;
                 }
-            }
+            });
 
             for (size_t b=2; b<bottom_blobs.size(); b++)
             {
                 const Mat& bottom_blob1 = bottom_blobs[b];
                 float coeff = coeffs_ptr[b];
-                #pragma omp parallel for
-                for (int q=0; q<channels; q++)
+                parallel_for(0, channels, [&](int q)
                 {
                     const float* ptr = bottom_blob1.channel(q);
                     float* outptr = top_blob.channel(q);
@@ -434,7 +429,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                         ptr++;
                         outptr++;
                     }
-                }
+                });
             }
         }
     }
@@ -442,8 +437,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
     {
         // first blob
         const Mat& bottom_blob1 = bottom_blobs[1];
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             const float* ptr1 = bottom_blob1.channel(q);
@@ -503,13 +497,12 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                 ptr1++;
                 outptr++;
             }
-        }
+        });
 
         for (size_t b=2; b<bottom_blobs.size(); b++)
         {
             const Mat& bottom_blob1 = bottom_blobs[b];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob1.channel(q);
                 float* outptr = top_blob.channel(q);
@@ -564,7 +557,7 @@ int Eltwise_arm::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
                     ptr++;
                     outptr++;
                 }
-            }
+            });
         }
     }
 
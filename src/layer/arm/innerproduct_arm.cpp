@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "innerproduct_arm.h"
+#include "threadpool.h"
 
 #if __ARM_NEON
 #include <arm_neon.h>
@@ -22,6 +23,19 @@ namespace ncnn {
 
 DEFINE_LAYER_CREATOR(InnerProduct_arm)
 
+#if __ARM_NEON
+static inline float reduce_add(float32x4_t _sum)
+{
+#if __aarch64__
+    return vaddvq_f32(_sum);
+#else
+    float32x2_t _sumss = vadd_f32(vget_low_f32(_sum), vget_high_f32(_sum));
+    _sumss = vpadd_f32(_sumss, _sumss);
+    return vget_lane_f32(_sumss, 0);
+#endif // __aarch64__
+}
+#endif // __ARM_NEON
+
 int InnerProduct_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
 {
     int w = bottom_blob.w;
@@ -35,8 +49,7 @@ int InnerProduct_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     // num_output
     const float* weight_data_ptr = weight_data;
-    #pragma omp parallel for
-    for (int p=0; p<num_output; p++)
+    parallel_for(0, num_output, [&](int p)
     {
         float* outptr = top_blob.channel(p);
         float sum = 0.f;
@@ -128,8 +141,132 @@ int InnerProduct_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
 #endif // __ARM_NEON
 
         outptr[0] = sum;
+    });
+
+    return 0;
+}
+
+int InnerProduct_arm::forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    const int batch = bottom_blobs.size();
+    for (int n=1; n<batch; n++)
+    {
+        if (bottom_blobs[n].w != bottom_blobs[0].w || bottom_blobs[n].h != bottom_blobs[0].h || bottom_blobs[n].c != bottom_blobs[0].c)
+            return Layer::forward_batch(bottom_blobs, top_blobs);
+    }
+
+    // the single sample kernel is as fast and reads the weights once anyway
+    if (batch < 4)
+        return Layer::forward_batch(bottom_blobs, top_blobs);
+
+    int w = bottom_blobs[0].w;
+    int h = bottom_blobs[0].h;
+    int channels = bottom_blobs[0].c;
+    int size = w * h;
+
+    top_blobs.resize(batch);
+    for (int n=0; n<batch; n++)
+    {
+        top_blobs[n].create(1, 1, num_output);
+        if (top_blobs[n].empty())
+            return -100;
     }
 
+    // num_output, each weight is loaded once for four samples
+    const float* weight_data_ptr = weight_data;
+    parallel_for(0, num_output, [&](int p)
+    {
+        const float bias = bias_term ? bias_data.data[p] : 0.f;
+
+        int n = 0;
+        for (; n+3<batch; n+=4)
+        {
+            float sum0 = bias;
+            float sum1 = bias;
+            float sum2 = bias;
+            float sum3 = bias;
+
+#if __ARM_NEON
+            float32x4_t _sum0 = vdupq_n_f32(0.f);
+            float32x4_t _sum1 = vdupq_n_f32(0.f);
+            float32x4_t _sum2 = vdupq_n_f32(0.f);
+            float32x4_t _sum3 = vdupq_n_f32(0.f);
+#endif // __ARM_NEON
+
+            // channels
+            for (int q=0; q<channels; q++)
+            {
+                const float* w = weight_data_ptr + size * channels * p + size * q;
+                const float* m0 = bottom_blobs[n].channel(q);
+                const float* m1 = bottom_blobs[n+1].channel(q);
+                const float* m2 = bottom_blobs[n+2].channel(q);
+                const float* m3 = bottom_blobs[n+3].channel(q);
+
+#if __ARM_NEON
+                int nn = size >> 2;
+                int remain = size & 3;
+#else
+                int remain = size;
+#endif // __ARM_NEON
+
+#if __ARM_NEON
+                for (; nn>0; nn--)
+                {
+                    float32x4_t _w = vld1q_f32(w);
+                    _sum0 = vmlaq_f32(_sum0, vld1q_f32(m0), _w);
+                    _sum1 = vmlaq_f32(_sum1, vld1q_f32(m1), _w);
+                    _sum2 = vmlaq_f32(_sum2, vld1q_f32(m2), _w);
+                    _sum3 = vmlaq_f32(_sum3, vld1q_f32(m3), _w);
+
+                    m0 += 4;
+                    m1 += 4;
+                    m2 += 4;
+                    m3 += 4;
+                    w += 4;
+                }
+#endif // __ARM_NEON
+                for (; remain>0; remain--)
+                {
+                    sum0 += *m0++ * *w;
+                    sum1 += *m1++ * *w;
+                    sum2 += *m2++ * *w;
+                    sum3 += *m3++ * *w;
+
+                    w++;
+                }
+            }
+
+#if __ARM_NEON
+            sum0 += reduce_add(_sum0);
+            sum1 += reduce_add(_sum1);
+            sum2 += reduce_add(_sum2);
+            sum3 += reduce_add(_sum3);
+#endif // __ARM_NEON
+
+            top_blobs[n].channel(p)[0] = sum0;
+            top_blobs[n+1].channel(p)[0] = sum1;
+            top_blobs[n+2].channel(p)[0] = sum2;
+            top_blobs[n+3].channel(p)[0] = sum3;
+        }
+        for (; n<batch; n++)
+        {
+            float sum = bias;
+
+            for (int q=0; q<channels; q++)
+            {
+                const float* w = weight_data_ptr + size * channels * p + size * q;
+                const float* m = bottom_blobs[n].channel(q);
+
+                for (int i = 0; i < size; i++)
+                {
+                    sum += m[i] * w[i];
+                }
+            }
+
+            top_blobs[n].channel(p)[0] = sum;
+        }
+    });
+
     return 0;
 }
 
@@ -23,6 +23,8 @@ class InnerProduct_arm : public InnerProduct
 {
 public:
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
+
+    virtual int forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
 };
 
 } // namespace ncnn
@@ -26,8 +26,7 @@ static void pooling2x2s2_max_neon(const Mat& bottom_blob, Mat& top_blob)
     int outh = top_blob.h;
     int outch = top_blob.c;
 
-    #pragma omp parallel for
-    for (int q=0; q<inch; q++)
+    parallel_for(0, inch, [&](int q)
     {
         const float* img0 = bottom_blob.channel(q);
         float* outptr = top_blob.channel(q);
@@ -108,5 +107,5 @@ static void pooling2x2s2_max_neon(const Mat& bottom_blob, Mat& top_blob)
             r0 += w;
             r1 += w;
         }
-    }
+    });
 }
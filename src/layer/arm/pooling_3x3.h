@@ -28,8 +28,7 @@ static void pooling3x3s2_max_neon(const Mat& bottom_blob, Mat& top_blob)
 
     const int tailstep = w - 2*outw + w;
 
-    #pragma omp parallel for
-    for (int q=0; q<inch; q++)
+    parallel_for(0, inch, [&](int q)
     {
         const float* img0 = bottom_blob.channel(q);
         float* outptr = top_blob.channel(q);
@@ -166,5 +165,5 @@ static void pooling3x3s2_max_neon(const Mat& bottom_blob, Mat& top_blob)
             r1 += tailstep;//1 + w;
             r2 += tailstep;//1 + w;
         }
-    }
+    });
 }
@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "pooling_arm.h"
+#include "threadpool.h"
 
 namespace ncnn {
 
@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "relu_arm.h"
+#include "threadpool.h"
 
 #if __ARM_NEON
 #include <arm_neon.h>
@@ -35,8 +36,7 @@ int ReLU_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     if (slope == 0.f)
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             float* outptr = top_blob.channel(q);
@@ -90,12 +90,11 @@ int ReLU_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
                 ptr++;
                 outptr++;
             }
-        }
+        });
     }
     else
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             float* outptr = top_blob.channel(q);
@@ -159,7 +158,7 @@ int ReLU_arm::forward(const Mat& bottom_blob, Mat& top_blob) const
                 ptr++;
                 outptr++;
             }
-        }
+        });
     }
 
     return 0;
@@ -174,8 +173,7 @@ int ReLU_arm::forward_inplace(Mat& bottom_top_blob) const
 
     if (slope == 0.f)
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             float* ptr = bottom_top_blob.channel(q);
 
@@ -224,12 +222,11 @@ int ReLU_arm::forward_inplace(Mat& bottom_top_blob) const
 
                 ptr++;
             }
-        }
+        });
     }
     else
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             float* ptr = bottom_top_blob.channel(q);
 
@@ -286,7 +283,7 @@ int ReLU_arm::forward_inplace(Mat& bottom_top_blob) const
 
                 ptr++;
             }
-        }
+        });
     }
 
     return 0;
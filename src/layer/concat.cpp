@@ -67,27 +67,54 @@ int Concat::forward_mrect(std::vector<MRect>& bottom_mrects, std::vector<MRect>&
     top_mrects.resize(1);
     MRect& mr = top_mrects[0];
     mr.set_offset(bottom_mrects[0].x_offset, bottom_mrects[0].y_offset);
-    for (size_t i = 0, max = bottom_mrects[0].size(); i < max; i ++) {
-        int x1 = bottom_mrects[0].changed_vecs[i].x1;
-        int y1 = bottom_mrects[0].changed_vecs[i].y1;
-        int x2 = bottom_mrects[0].changed_vecs[i].x2;
-        int y2 = bottom_mrects[0].changed_vecs[i].y2;
-        for (size_t j = 1, maxx = bottom_mrects.size(); j < maxx; j ++) {
-            const struct rect temp = bottom_mrects[j].changed_vecs[i];
-            if (temp.x1 <= x1 && temp.y1 <= y1) {
-                x1 = temp.x1;
-                y1 = temp.y1;
-            }
-            if (temp.x2 >= x2 && temp.y2 >= y2) {
-                x2 = temp.x2;
-                y2 = temp.y2;
+    mr.copy_motion(bottom_mrects[0]);
+    // the top changes wherever any bottom does, the bottoms may carry
+    // different rect counts once a branch shrinks its rects by feature
+    for (size_t j = 0, maxx = bottom_mrects.size(); j < maxx; j ++) {
+        const MRect& m = bottom_mrects[j];
+        if (m.x_offset != mr.x_offset || m.y_offset != mr.y_offset || m.affine != mr.affine) {
+            // bottoms moved differently, nothing lines up with the cache
+            mr.add_rect(0, 0, MRECT_FULL, MRECT_FULL);
+        }
+        mr.changed_vecs.insert(mr.changed_vecs.end(), m.changed_vecs.begin(), m.changed_vecs.end());
+    }
+    // matched blocks of all bottoms, a block several bottoms report keeps
+    // its worst match quality
+    for (size_t j = 0, maxx = bottom_mrects.size(); j < maxx; j ++) {
+        for (const struct rect& temp: bottom_mrects[j].matched_vecs) {
+            size_t k = 0;
+            for (; k < mr.matched_vecs.size(); k ++) {
+                struct rect& r = mr.matched_vecs[k];
+                if (r.x1 == temp.x1 && r.y1 == temp.y1 && r.x2 == temp.x2 && r.y2 == temp.y2) {
+                    r.psnr = std::min(r.psnr, temp.psnr);
+                    break;
+                }
             }
+            if (k == mr.matched_vecs.size())
+                mr.matched_vecs.push_back(temp);
         }
-        mr.add_rect(x1, y1, x2, y2);
-        // LOGI("YYYYY %d %d %d %d\n", x1, y1, x2, y2);
     }
     return 0;
 }
 #endif
 
+int Concat::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.empty() || top_shapes.empty())
+        return -1;
+
+    int top_channels = 0;
+    for (size_t b=0; b<bottom_shapes.size(); b++)
+    {
+        if (bottom_shapes[b].dims == 0)
+            return -1;
+
+        top_channels += bottom_shapes[b].c;
+    }
+
+    top_shapes[0] = MatShape(bottom_shapes[0].w, bottom_shapes[0].h, top_channels);
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "convolution.h"
+#include "threadpool.h"
 
 namespace ncnn {
 
@@ -22,6 +23,7 @@ Convolution::Convolution()
 {
     one_blob_only = true;
     support_inplace = false;
+    activation_type = 0;
 }
 
 Convolution::~Convolution()
@@ -294,9 +296,6 @@ int Convolution::forward(const Mat& bottom_blob, Mat& top_blob) const
     int outw = (w - kernel_extent) / stride + 1;
     int outh = (h - kernel_extent) / stride + 1;
 
-    LOGI("Convolution::forward input=%dx%dx%d pad=%d ksize=%d output=%d stride=%d\n",
-        w, h, channels, pad, kernel_size, num_output, stride);
-
     top_blob.create(outw, outh, num_output);
     if (top_blob.empty())
         return -100;
@@ -324,8 +323,7 @@ int Convolution::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     // num_output
     const float* weight_data_ptr = weight_data;
-    #pragma omp parallel for
-    for (int p=0; p<num_output; p++)
+    parallel_for(0, num_output, [&](int p)
     {
         float* outptr = top_blob.channel(p);
 
@@ -356,26 +354,205 @@ int Convolution::forward(const Mat& bottom_blob, Mat& top_blob) const
                     kptr += maxk;
                 }
 
-                outptr[j] = sum;
+                outptr[j] = activate(sum, p);
             }
 
             outptr += outw;
         }
-    }
+    });
 
     log_time_end("conv");
 
     return 0;
 }
 
+static void conv_phase_rows(const float* band, int band_rows, int phase_w, Mat& top_blob,
+                            int oy0, int orows, const Mat& weight_data, const Mat& bias_data, int kernel_size)
+{
+    const int outw = top_blob.w;
+    const int outch = top_blob.c;
+    const int maxk = kernel_size * kernel_size;
+    const int row_size = phase_w * 2;
+    const int channel_size = band_rows * row_size;
+
+    // band offset of each tap for output row 0, column 0
+    std::vector<int> _tap_ofs(3 * maxk);
+    int* tap_ofs = &_tap_ofs[0];
+    for (int q = 0; q < 3; q++)
+    {
+        for (int ky = 0; ky < kernel_size; ky++)
+        {
+            for (int kx = 0; kx < kernel_size; kx++)
+                tap_ofs[q * maxk + ky * kernel_size + kx] = q * channel_size + ky * row_size + (kx & 1) * phase_w + (kx >> 1);
+        }
+    }
+
+    const float* bias = bias_data;
+
+    for (int p = 0; p < outch; p++)
+    {
+        const float* kptr = (const float*)weight_data + p * 3 * maxk;
+        const float bias0 = bias ? bias[p] : 0.f;
+
+        for (int r = 0; r < orows; r++)
+        {
+            const float* rowptr = band + 2 * r * row_size;
+            float* outptr = top_blob.channel(p).row(oy0 + r);
+
+            for (int x = 0; x < outw; x++)
+            {
+                float sum = bias0;
+                for (int k = 0; k < 3 * maxk; k++)
+                    sum += kptr[k] * rowptr[tap_ofs[k] + x];
+
+                outptr[x] = sum;
+            }
+        }
+    }
+}
+
+int Convolution::forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                                const float* mean_vals, const float* norm_vals, Mat& top_blob) const
+{
+    if (!support_pixels(type))
+        return Layer::forward_pixels(pixels, type, w, h, mean_vals, norm_vals, top_blob);
+
+    return forward_pixels_s2(pixels, type, w, h, mean_vals, norm_vals, top_blob, conv_phase_rows);
+}
+
+bool Convolution::support_pixels(int type) const
+{
+    if (stride != 2 || dilation != 1 || pad < 0)
+        return false;
+
+    if (weight_data_size != num_output * 3 * kernel_size * kernel_size)
+        return false;
+
+    return type == Mat::PIXEL_RGB || type == Mat::PIXEL_BGR
+        || type == Mat::PIXEL_RGB2BGR || type == Mat::PIXEL_BGR2RGB
+        || type == Mat::PIXEL_RGBA2RGB || type == Mat::PIXEL_RGBA2BGR;
+}
+
+int Convolution::forward_pixels_s2(const unsigned char* pixels, int type, int w, int h,
+                                   const float* mean_vals, const float* norm_vals, Mat& top_blob, conv_pixels_func conv) const
+{
+    int outw = (w + 2 * pad - kernel_size) / 2 + 1;
+    int outh = (h + 2 * pad - kernel_size) / 2 + 1;
+    if (outw <= 0 || outh <= 0)
+        return -1;
+
+    top_blob.create(outw, outh, num_output);
+    if (top_blob.empty())
+        return -100;
+
+    const int phase_w = outw + (kernel_size - 1) / 2;
+
+    // bands of output rows, each converts only the input rows it reads
+    const int band_out = 8;
+    const int band_count = (outh + band_out - 1) / band_out;
+
+    parallel_for(0, band_count, [&](int b)
+    {
+        const int oy0 = b * band_out;
+        const int orows = std::min(band_out, outh - oy0);
+        const int band_rows = 2 * (orows - 1) + kernel_size;
+
+        std::vector<float> band(3 * band_rows * phase_w * 2);
+        pixels_to_phase_rows(pixels, type, w, h, oy0 * 2, band_rows, phase_w, mean_vals, norm_vals, &band[0]);
+
+        conv(&band[0], band_rows, phase_w, top_blob, oy0, orows, weight_data, bias_data, kernel_size);
+
+        // the band rows are still in cache
+        if (activation_type != 0)
+        {
+            for (int p = 0; p < num_output; p++)
+            {
+                float* outptr = top_blob.channel(p).row(oy0);
+                for (int i = 0; i < orows * outw; i++)
+                    outptr[i] = activate(outptr[i], p);
+            }
+        }
+    });
+
+    return 0;
+}
+
+void Convolution::pixels_to_phase_rows(const unsigned char* pixels, int type, int w, int h, int y0, int rows, int phase_w,
+                                       const float* mean_vals, const float* norm_vals, float* band) const
+{
+    const int elempack = (type & Mat::PIXEL_FORMAT_MASK) == Mat::PIXEL_RGBA ? 4 : 3;
+    const bool swap_rb = type == Mat::PIXEL_RGB2BGR || type == Mat::PIXEL_BGR2RGB || type == Mat::PIXEL_RGBA2BGR;
+
+    for (int q = 0; q < 3; q++)
+    {
+        const int sq = swap_rb ? 2 - q : q;
+        const float mean = mean_vals ? mean_vals[q] : 0.f;
+        const float norm = norm_vals ? norm_vals[q] : 1.f;
+
+        for (int r = 0; r < rows; r++)
+        {
+            float* even = band + (q * rows + r) * phase_w * 2;
+            float* odd = even + phase_w;
+
+            const int iy = y0 + r - pad;
+            if (iy < 0 || iy >= h)
+            {
+                memset(even, 0, phase_w * 2 * sizeof(float));
+                continue;
+            }
+
+            const unsigned char* line = pixels + iy * w * elempack + sq;
+            for (int i = 0; i < phase_w; i++)
+            {
+                const int ix = i * 2 - pad;
+                even[i] = ix >= 0 && ix < w ? (line[ix * elempack] - mean) * norm : 0.f;
+                odd[i] = ix + 1 >= 0 && ix + 1 < w ? (line[(ix + 1) * elempack] - mean) * norm : 0.f;
+            }
+        }
+    }
+}
+
+void Convolution::activate(Mat& top_blob, const bool* changed_map) const
+{
+    if (activation_type == 0)
+        return;
+
+    const int size = top_blob.w * top_blob.h;
+
+    parallel_for(0, top_blob.c, [&](int p)
+    {
+        float* ptr = top_blob.channel(p);
+        const float slope = activation_params.data[activation_params.w == 1 ? 0 : p];
+
+        for (int i = 0; i < size; i++)
+        {
+            if (ptr[i] < 0.f && (!changed_map || changed_map[i]))
+                ptr[i] *= slope;
+        }
+    });
+}
+
 #if NCNN_CNNCACHE
 int Convolution::forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const
 {
     // LOGI("Convolution::forward_mrect info: %s\n", bottom_mrect.info().c_str());
     top_mrect.forward_in_conv_or_pool(bottom_mrect, pad, kernel_size, stride);
+    top_mrect.guard_warp();
     return 0;
 }
 
+bool Convolution::input_window(int& _kernel_extent, int& _stride, int& _pad) const
+{
+    // same padding depends on the input size
+    if (pad < 0)
+        return false;
+
+    _kernel_extent = dilation * (kernel_size - 1) + 1;
+    _stride = stride;
+    _pad = pad;
+    return true;
+}
+
 int Convolution::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
 {
     // convolv with NxN kernel
@@ -387,16 +564,11 @@ int Convolution::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mr
 
     log_time_begin();
 
-    // Step 1: copy the cahced blocks
-    // Step 2: make a bitmap specifying which can be reused
-    // Step 3: re-calculate other blocks
-
     int w = bottom_blob.w;
     int h = bottom_blob.h;
-    int channels = bottom_blob.c;
 
     // LOGI("Convolution::forward_cached input=%dx%dx%d pad=%d ksize=%d output=%d stride=%d\n",
-    //     w, h, channels, pad, kernel_size, num_output, stride);
+    //     w, h, bottom_blob.c, pad, kernel_size, num_output, stride);
     // LOGI("mrect info: %s\n", mrect.info().c_str());
 
     const int kernel_extent = dilation * (kernel_size - 1) + 1;
@@ -437,12 +609,64 @@ int Convolution::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mr
     if (top_blob.empty())
         return -100;
 
-    if (mrect.size() == 0) {
+    if (mrect.size() == 0 && !mrect.affine) {
         memcpy(top_blob.data, cached_blob.data, cached_blob.total() * sizeof(float));
         log_time_end("conv_cached");
         return 0;
     }
 
+    bool* changed_map = (bool*) malloc(outh * outw * sizeof(bool));
+    if (!changed_map)
+        return -100;
+
+    mrect.build_changed_map(changed_map, outw, outh);
+
+    // Step 1: bulk copy the reused region, resampled under affine motion
+    // Step 2: gather the changed pixels and recompute them with one gemm
+    if (mrect.affine)
+        mrect.warp_cached(cached_blob, top_blob, changed_map);
+    else
+        mrect.copy_cached(cached_blob, top_blob);
+
+    int ret = forward_gemm_changed(bottom_blob_bordered, top_blob, changed_map);
+
+    free(changed_map);
+
+    if (mrect.affine)
+        log_time_end("conv_cached_warp");
+    else
+        log_time_end("conv_cached");
+
+    return ret;
+}
+
+int Convolution::forward_gemm_changed(const Mat& bottom_blob_bordered, Mat& top_blob, const bool* changed_map) const
+{
+    const int outw = top_blob.w;
+    const int outh = top_blob.h;
+
+    // compacted list of the output positions to recompute
+    std::vector<int> positions;
+    for (int i = 0; i < outh * outw; i++)
+    {
+        if (changed_map[i])
+            positions.push_back(i);
+    }
+
+    std::vector<Mat> bottom_blobs_bordered(1, bottom_blob_bordered);
+    std::vector<Mat> top_blobs(1, top_blob);
+    return forward_gemm(bottom_blobs_bordered, top_blobs, positions);
+}
+
+#endif
+
+int Convolution::forward_gemm(const std::vector<Mat>& bottom_blobs_bordered, std::vector<Mat>& top_blobs, const std::vector<int>& positions) const
+{
+    const int w = bottom_blobs_bordered[0].w;
+    const int channels = bottom_blobs_bordered[0].c;
+    const int outw = top_blobs[0].w;
+    const int outsize = top_blobs[0].w * top_blobs[0].h;
+
     const int maxk = kernel_size * kernel_size;
 
     // kernel offsets
@@ -464,130 +688,304 @@ int Convolution::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mr
         }
     }
 
-    // Step 1 & Step 2
-    // TODO: make it run on multiple threads
-    int* cached_map = (int*) calloc(outh * outw, sizeof(int));
-
-    std::vector<int> xx;
-    std::vector<int> yy;
-    for (int h = 0; h < outh; h ++) {
-        xx.resize(0);
-        yy.resize(0);
-        for (size_t i = 0, max = mrect.size(); i < max; i ++) {
-            struct rect r = mrect.changed_vecs[i];
-            if (r.y1 <= h && r.y2 >= h) {
-                xx.push_back(r.x1);
-                yy.push_back(r.x2);
-            }
-        }
-        // bubble sort
-        for (int p = 0, max = xx.size(); p < max - 1; p ++)
-            for (int q = max - 1; q > p; q --) {
-                if (xx[q] < xx[q - 1]) {
-                    int temp = xx[q];
-                    xx[q] = xx[q - 1];
-                    xx[q - 1] = temp;
-
-                    temp = yy[q];
-                    yy[q] = yy[q - 1];
-                    yy[q - 1] = temp;
-                }
-            }
-        xx.push_back(outw);
-        yy.push_back(outw);
-        int start = 0;
-        for (size_t i = 0, max = xx.size(); i < max; i ++) {
-            if (xx[i] > start) {
-                // LOGI("Reuse h: %d, [%d, %d]\n", h, start, xx[i]);
-                // reuse [start, xx[i])
-                cached_map[h * outw + start] = xx[i] - start;
-                start = yy[i] + 1;
-            }
-            if (xx[i] <= start) {
-                start = std::max(start, yy[i]);
-            }
-        }
+    const int count = positions.size();
+    if (count == 0)
+        return 0;
 
-    }
+    // gemm M = num_output, K = channels * maxk, N = count
+    // done in column tiles so the packed im2col stays in cache
+    const int K = channels * maxk;
+    const int tile = 64;
+    const int tile_count = (count + tile - 1) / tile;
 
+    // the tiles of a chunk are packed first, then each pair of tile and
+    // four output channels is a task, so a dirty set of one tile still
+    // spreads over the output channels
+    const int chunk = std::max(1, (1 << 20) / (K * tile));
+    const int block_count = (num_output + 3) / 4;
 
+    const float* weight_data_ptr = weight_data;
+    const float* bias_data_ptr = bias_term ? (const float*)bias_data : 0;
 
-    // for (size_t i = 0, max = mrect.size(); i < max; i ++) {
-    //     struct rect pre = mrect.pre[i];
-    //     struct rect cur = mrect.cur[i];
-    //     // #pragma omp parallel for
-    //     for (int j = 0; j < num_output; j ++) {
-    //         float* pre_ptr = cached_blob.channel(j).row(pre.y1) + pre.x1;
-    //         float* cur_ptr = top_blob.channel(j).row(cur.y1) + cur.x1;
-    //         int offset = (pre.x2 - pre.x1 + 1) * sizeof(float);
-    //         for (int k = cur.y1; k <= cur.y2; k ++) {
-    //             // Step 2: build cache map
-    //             cached_map[k * outw + cur.x1] = pre.x2 - pre.x1 + 1;
-    //             // Step 1: copy cached block
-    //             memcpy(cur_ptr, pre_ptr, offset);
-    //             pre_ptr += top_blob.w;
-    //             cur_ptr += top_blob.w;
-    //         }
-    //     }
-    // }
+    std::vector<float> _col((size_t)K * tile * std::min(chunk, tile_count));
 
-    // num_output
-    const float* weight_data_ptr = weight_data;
-    #pragma omp parallel for
-    for (int p=0; p<num_output; p++)
+    for (int t0 = 0; t0 < tile_count; t0 += chunk)
     {
-        float* outptr = top_blob.channel(p);
+        const int tn = std::min(chunk, tile_count - t0);
 
-        for (int i = 0; i < outh; i++)
+        // packed im2col, K rows of nn output pixels per tile
+        parallel_for(0, tn, [&](int t)
         {
-            for (int j = 0; j < outw; j++)
+            const int n0 = (t0 + t) * tile;
+            const int nn = std::min(tile, count - n0);
+
+            float* col = &_col[(size_t)K * tile * t];
+            for (int n = 0; n < nn; n++)
             {
-                // Reuse the block
-                int temp = cached_map[i * outw + j];
-                if (temp > 0) {
-                    float* pre_ptr = cached_blob.channel(p).row(i + mrect.y_offset) + (j + mrect.x_offset);
-                    memcpy(&outptr[j], pre_ptr, temp * sizeof(float));
-                    j += (temp - 1);
-                    continue;
+                const int pos = positions[n0 + n];
+                const Mat& bottom_blob_bordered = bottom_blobs_bordered[pos / outsize];
+                const int i = pos % outsize / outw;
+                const int j = pos % outsize % outw;
+
+                float* colptr = col + n;
+                for (int q = 0; q < channels; q++)
+                {
+                    const Mat m = bottom_blob_bordered.channel(q);
+                    const float* sptr = m.data + m.w * i*stride + j*stride;
+
+                    for (int k = 0; k < maxk; k++)
+                    {
+                        *colptr = sptr[ space_ofs[k] ];
+                        colptr += tile;
+                    }
                 }
+            }
+        });
 
-                float sum = 0.f;
+        parallel_for(0, tn * block_count, [&](int task)
+        {
+            const int t = task / block_count;
+            const int p = task % block_count * 4;
+            const int n0 = (t0 + t) * tile;
+            const int nn = std::min(tile, count - n0);
+            const float* col = &_col[(size_t)K * tile * t];
 
-                if (bias_term)
-                    sum = bias_data.data[p];
+            float sum[4][tile];
 
-                const float* kptr = weight_data_ptr + maxk * channels * p;
+            if (p + 3 < num_output)
+            {
+                // four output channels, each weight row streamed once per tile
+                for (int r = 0; r < 4; r++)
+                {
+                    const float bias0 = bias_data_ptr ? bias_data_ptr[p + r] : 0.f;
+                    for (int n = 0; n < nn; n++)
+                        sum[r][n] = bias0;
+                }
 
-                // channels
-                for (int q=0; q<channels; q++)
+                const float* kptr0 = weight_data_ptr + K * p;
+                const float* kptr1 = kptr0 + K;
+                const float* kptr2 = kptr1 + K;
+                const float* kptr3 = kptr2 + K;
+
+                for (int k = 0; k < K; k++)
                 {
-                    const Mat m = bottom_blob_bordered.channel(q);
-                    const float* sptr = m.data + m.w * i*stride + j*stride;
+                    const float* colptr = col + k * tile;
+                    const float k0 = kptr0[k];
+                    const float k1 = kptr1[k];
+                    const float k2 = kptr2[k];
+                    const float k3 = kptr3[k];
 
-                    for (int k = 0; k < maxk; k++) // 29.23
+                    for (int n = 0; n < nn; n++)
                     {
-                        float val = sptr[ space_ofs[k] ]; // 20.72
-                        float w = kptr[k];
-                        sum += val * w; // 41.45
+                        sum[0][n] += k0 * colptr[n];
+                        sum[1][n] += k1 * colptr[n];
+                        sum[2][n] += k2 * colptr[n];
+                        sum[3][n] += k3 * colptr[n];
                     }
+                }
 
-                    kptr += maxk;
+                // scatter
+                for (int r = 0; r < 4; r++)
+                {
+                    for (int n = 0; n < nn; n++)
+                    {
+                        const int pos = positions[n0 + n];
+                        float* outptr = top_blobs[pos / outsize].channel(p + r);
+                        outptr[pos % outsize] = activate(sum[r][n], p + r);
+                    }
                 }
+                return;
+            }
 
-                outptr[j] = sum;
+            // the remaining output channels one at a time
+            for (int pp = p; pp < num_output; pp++)
+            {
+                const float bias0 = bias_data_ptr ? bias_data_ptr[pp] : 0.f;
+                for (int n = 0; n < nn; n++)
+                    sum[0][n] = bias0;
+
+                const float* kptr = weight_data_ptr + K * pp;
+                for (int k = 0; k < K; k++)
+                {
+                    const float* colptr = col + k * tile;
+                    const float k0 = kptr[k];
+
+                    for (int n = 0; n < nn; n++)
+                        sum[0][n] += k0 * colptr[n];
+                }
+
+                for (int n = 0; n < nn; n++)
+                {
+                    const int pos = positions[n0 + n];
+                    float* outptr = top_blobs[pos / outsize].channel(pp);
+                    outptr[pos % outsize] = activate(sum[0][n], pp);
+                }
             }
+        });
+    }
 
-            outptr += outw;
-        }
+    return 0;
+}
+
+int Convolution::forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    const int batch = bottom_blobs.size();
+
+    bool same_shape = batch > 1;
+    for (int n=0; n<batch && same_shape; n++)
+    {
+        const Mat& m = bottom_blobs[n];
+        if (m.dims != 3 || m.w != bottom_blobs[0].w || m.h != bottom_blobs[0].h || m.c != bottom_blobs[0].c)
+            same_shape = false;
     }
 
-    free(cached_map);
+    if (!same_shape)
+        return Layer::forward_batch(bottom_blobs, top_blobs);
+
+    // a pointwise kernel sees every pixel alone, so the samples stacked
+    // along h make one image and the weights stream once for the batch
+    if (kernel_size != 1 || stride != 1 || (pad != 0 && pad != -233))
+        return forward_batch_gemm(bottom_blobs, top_blobs);
+
+    int w = bottom_blobs[0].w;
+    int h = bottom_blobs[0].h;
+    int channels = bottom_blobs[0].c;
+    int size = w * h;
+
+    Mat stacked(w, h * batch, channels);
+    if (stacked.empty())
+        return -100;
+
+    parallel_for(0, channels, [&](int q)
+    {
+        float* outptr = stacked.channel(q);
+        for (int n=0; n<batch; n++)
+        {
+            memcpy(outptr + size * n, bottom_blobs[n].channel(q), size * sizeof(float));
+        }
+    });
+
+    // the arch specific kernels run on the stacked image as well
+    Mat stacked_top;
+    int ret = forward(stacked, stacked_top);
+    if (ret != 0)
+        return ret;
+
+    top_blobs.resize(batch);
+    for (int n=0; n<batch; n++)
+    {
+        top_blobs[n].create(w, h, num_output);
+        if (top_blobs[n].empty())
+            return -100;
+    }
 
-    log_time_end("conv_cached");
+    parallel_for(0, num_output, [&](int p)
+    {
+        const float* ptr = stacked_top.channel(p);
+        for (int n=0; n<batch; n++)
+        {
+            memcpy(top_blobs[n].channel(p), ptr + size * n, size * sizeof(float));
+        }
+    });
 
     return 0;
 }
 
-#endif
+int Convolution::forward_batch_gemm(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    const int batch = bottom_blobs.size();
+
+    int w = bottom_blobs[0].w;
+    int h = bottom_blobs[0].h;
+    int channels = bottom_blobs[0].c;
+
+    // grouped weights do not make one gemm
+    if (weight_data_size != num_output * channels * kernel_size * kernel_size)
+        return Layer::forward_batch(bottom_blobs, top_blobs);
+
+    const int kernel_extent = dilation * (kernel_size - 1) + 1;
+
+    std::vector<Mat> bottom_blobs_bordered(bottom_blobs);
+    for (int n=0; n<batch; n++)
+    {
+        if (pad > 0)
+        {
+            copy_make_border(bottom_blobs[n], bottom_blobs_bordered[n], pad, pad, pad, pad, BORDER_CONSTANT, 0.f);
+            if (bottom_blobs_bordered[n].empty())
+                return -100;
+        }
+        else if (pad == -233)
+        {
+            int wpad = kernel_extent + (w - 1) / stride * stride - w;
+            int hpad = kernel_extent + (h - 1) / stride * stride - h;
+            if (wpad > 0 || hpad > 0)
+            {
+                copy_make_border(bottom_blobs[n], bottom_blobs_bordered[n], hpad / 2, hpad - hpad / 2, wpad / 2, wpad - wpad / 2, BORDER_CONSTANT, 0.f);
+                if (bottom_blobs_bordered[n].empty())
+                    return -100;
+            }
+        }
+    }
+
+    w = bottom_blobs_bordered[0].w;
+    h = bottom_blobs_bordered[0].h;
+
+    int outw = (w - kernel_extent) / stride + 1;
+    int outh = (h - kernel_extent) / stride + 1;
+
+    top_blobs.resize(batch);
+    for (int n=0; n<batch; n++)
+    {
+        top_blobs[n].create(outw, outh, num_output);
+        if (top_blobs[n].empty())
+            return -100;
+    }
+
+    // every output pixel of the batch, the column tiles of the gemm run
+    // across the samples
+    std::vector<int> positions(batch * outw * outh);
+    for (size_t i=0; i<positions.size(); i++)
+    {
+        positions[i] = i;
+    }
+
+    return forward_gemm(bottom_blobs_bordered, top_blobs, positions);
+}
+
+int Convolution::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    int w = bottom_shape.w;
+    int h = bottom_shape.h;
+
+    const int kernel_extent = dilation * (kernel_size - 1) + 1;
+
+    if (pad > 0)
+    {
+        w += pad * 2;
+        h += pad * 2;
+    }
+    else if (pad == -233)
+    {
+        int wpad = kernel_extent + (w - 1) / stride * stride - w;
+        int hpad = kernel_extent + (h - 1) / stride * stride - h;
+        if (wpad > 0 || hpad > 0)
+        {
+            w += wpad;
+            h += hpad;
+        }
+    }
+
+    int outw = (w - kernel_extent) / stride + 1;
+    int outh = (h - kernel_extent) / stride + 1;
+    if (outw <= 0 || outh <= 0)
+        return -1;
+
+    top_shape = MatShape(outw, outh, num_output);
+
+    return 0;
+}
 
 } // namespace ncnn
@@ -37,12 +37,60 @@ public:
 
     virtual int forward(const Mat& bottom_blobs, Mat& top_blobs) const;
 
+    // pointwise kernels run once on the samples stacked along h, any other
+    // geometry as one im2col gemm over the whole batch
+    virtual int forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
+
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
+    virtual int forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                               const float* mean_vals, const float* norm_vals, Mat& top_blob) const;
+
 #if NCNN_CNNCACHE
     virtual int forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const;
     virtual int forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const;
     virtual bool needs_cache() const {return true;}
+    virtual bool input_window(int& kernel_extent, int& stride, int& pad) const;
+
+protected:
+    // recompute the flagged pixels of top_blob through a packed im2col gemm
+    int forward_gemm_changed(const Mat& bottom_blob_bordered, Mat& top_blob, const bool* changed_map) const;
 #endif
 
+protected:
+    // compute the listed output pixels through a packed im2col gemm
+    // position n * outw * outh + i is pixel i of sample n
+    int forward_gemm(const std::vector<Mat>& bottom_blobs_bordered, std::vector<Mat>& top_blobs, const std::vector<int>& positions) const;
+    // batch of any kernel geometry as one gemm over all samples
+    int forward_batch_gemm(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
+
+    // convolve one band of output rows from the phase rows of its input
+    typedef void (*conv_pixels_func)(const float* band, int band_rows, int phase_w, Mat& top_blob,
+                                     int oy0, int orows, const Mat& weight_data, const Mat& bias_data, int kernel_size);
+
+    // stride 2 stem on three channel pixels, fused with the pixel conversion
+    bool support_pixels(int type) const;
+    int forward_pixels_s2(const unsigned char* pixels, int type, int w, int h,
+                          const float* mean_vals, const float* norm_vals, Mat& top_blob, conv_pixels_func conv) const;
+    // normalized, zero padded float rows of the padded input rows [y0, y0 + rows),
+    // split in even and odd columns so stride 2 taps read contiguously
+    // layout is [channel][row][even, odd][phase_w]
+    void pixels_to_phase_rows(const unsigned char* pixels, int type, int w, int h, int y0, int rows, int phase_w,
+                              const float* mean_vals, const float* norm_vals, float* band) const;
+
+    // the fused activation of value v of output channel p
+    float activate(float v, int p) const
+    {
+        if (activation_type == 0 || v > 0.f)
+            return v;
+
+        return v * activation_params.data[activation_params.w == 1 ? 0 : p];
+    }
+    // the fused activation over top_blob for kernels storing the raw sums,
+    // only on the pixels flagged in changed_map if given, the others came
+    // from the cache already activated
+    void activate(Mat& top_blob, const bool* changed_map = 0) const;
+
 public:
     // param
     int num_output;
@@ -57,6 +105,12 @@ public:
     // model
     Mat weight_data;
     Mat bias_data;
+
+    // activation folded in at load time, applied as the outputs are stored
+    // 0 none, 1 relu and prelu, negative values scaled by activation_params,
+    // one slope for all output channels or one per channel
+    int activation_type;
+    Mat activation_params;
 };
 
 } // namespace ncnn
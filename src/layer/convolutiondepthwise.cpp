@@ -176,7 +176,7 @@ int ConvolutionDepthWise::forward(const Mat& bottom_blob, Mat& top_blob) const
                         sum += val * w;
                     }
 
-                    outptr[j] = sum;
+                    outptr[j] = activate(sum, g);
                 }
 
                 outptr += outw;
@@ -224,7 +224,7 @@ int ConvolutionDepthWise::forward(const Mat& bottom_blob, Mat& top_blob) const
                         kptr += maxk;
                     }
 
-                    outptr[j] = sum;
+                    outptr[j] = activate(sum, g * num_output_g + p);
                 }
 
                 outptr += outw;
@@ -242,21 +242,13 @@ int ConvolutionDepthWise::forward_mrect(MRect& bottom_mrect, MRect& top_mrect) c
 {
     // LOGI("Convolution::forward_mrect info: %s\n", bottom_mrect.info().c_str());
     top_mrect.forward_in_conv_or_pool(bottom_mrect, pad, kernel_size, stride);
+    top_mrect.guard_warp();
     return 0;
 }
 
-// TODO: implement it
-int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
+int ConvolutionDepthWise::prepare_cached(const Mat& bottom_blob, Mat& bottom_blob_bordered, Mat& top_blob, MRect& mrect, const Mat& cached_blob, bool*& cached_map) const
 {
-    if (group == 1)
-    {
-        return Convolution::forward_cached(bottom_blob, top_blob, mrect, cached_blob);
-    }
-
-    log_time_begin();
-
-    // convolv with NxN kernel
-    // value = value + bias
+    cached_map = 0;
 
     int w = bottom_blob.w;
     int h = bottom_blob.h;
@@ -268,11 +260,9 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
         return -100;
     }
 
-//     fprintf(stderr, "ConvolutionDepthWise input %d x %d  pad = %d  ksize=%d  stride=%d\n", w, h, pad, kernel_size, stride);
-
     const int kernel_extent = dilation * (kernel_size - 1) + 1;
 
-    Mat bottom_blob_bordered = bottom_blob;
+    bottom_blob_bordered = bottom_blob;
     if (pad > 0)
     {
         copy_make_border(bottom_blob, bottom_blob_bordered, pad, pad, pad, pad, BORDER_CONSTANT, 0.f);
@@ -300,10 +290,78 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
     int outw = (w - kernel_extent) / stride + 1;
     int outh = (h - kernel_extent) / stride + 1;
 
+    // If the output feature map is already too squeezed, don't reuse
+    if (outw <= 5 || outh <= 5)
+        return 2;
+
+    if (cached_blob.w != outw || cached_blob.h != outh || cached_blob.c != num_output)
+        return 2;
+
+    // No room for reusing now!
+    if (mrect.full_changed(outw, outh))
+        return 2;
+
     top_blob.create(outw, outh, num_output);
     if (top_blob.empty())
         return -100;
 
+    if (mrect.size() == 0 && !mrect.affine)
+    {
+        memcpy(top_blob.data, cached_blob.data, top_blob.total() * sizeof(float));
+        return 1;
+    }
+
+    cached_map = (bool*) malloc(outh * outw * sizeof(bool));
+    if (!cached_map)
+        return -100;
+
+    mrect.build_changed_map(cached_map, outw, outh);
+
+    if (skip_reuse(cached_map, outw, outh))
+    {
+        free(cached_map);
+        cached_map = 0;
+        return 2;
+    }
+
+    // Resample the cache under affine motion, it may flag more pixels
+    if (mrect.affine)
+        mrect.warp_cached(cached_blob, top_blob, cached_map);
+    else
+        mrect.copy_cached(cached_blob, top_blob);
+
+    return 0;
+}
+
+int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
+{
+    if (group == 1)
+    {
+        return Convolution::forward_cached(bottom_blob, top_blob, mrect, cached_blob);
+    }
+
+    if (cached_blob.empty())
+    {
+        return ConvolutionDepthWise::forward(bottom_blob, top_blob);
+    }
+
+    log_time_begin();
+
+    Mat bottom_blob_bordered;
+    bool* cached_map;
+    int ret = prepare_cached(bottom_blob, bottom_blob_bordered, top_blob, mrect, cached_blob, cached_map);
+    if (ret == 1)
+        return 0;
+    if (ret == 2)
+        return ConvolutionDepthWise::forward(bottom_blob, top_blob);
+    if (ret != 0)
+        return ret;
+
+    const int w = bottom_blob_bordered.w;
+    const int channels = bottom_blob.c;
+    const int outw = top_blob.w;
+    const int outh = top_blob.h;
+
     const int maxk = kernel_size * kernel_size;
 
     // kernel offsets
@@ -325,6 +383,7 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
         }
     }
 
+    // only the flagged pixels are computed, the rest came from the cache
     // depth-wise
     if (channels == group && group == num_output)
     {
@@ -334,11 +393,15 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
             float* outptr = top_blob.channel(g);
             const float* kptr = weight_data + maxk * g;
             const Mat m = bottom_blob_bordered.channel(g);
+            const bool* flag = cached_map;
 
             for (int i = 0; i < outh; i++)
             {
                 for (int j = 0; j < outw; j++)
                 {
+                    if (!flag[j])
+                        continue;
+
                     float sum = 0.f;
 
                     if (bias_term)
@@ -353,13 +416,18 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
                         sum += val * w;
                     }
 
-                    outptr[j] = sum;
+                    outptr[j] = activate(sum, g);
                 }
 
                 outptr += outw;
+                flag += outw;
             }
         }
 
+        free(cached_map);
+
+        log_time_end("convdepthwise_cached");
+
         return 0;
     }
 
@@ -373,11 +441,15 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
         {
             float* outptr = top_blob.channel(g * num_output_g + p);
             const float* weight_data_ptr = weight_data + maxk * channels_g * num_output_g * g;
+            const bool* flag = cached_map;
 
             for (int i = 0; i < outh; i++)
             {
                 for (int j = 0; j < outw; j++)
                 {
+                    if (!flag[j])
+                        continue;
+
                     float sum = 0.f;
 
                     if (bias_term)
@@ -401,14 +473,17 @@ int ConvolutionDepthWise::forward_cached(const Mat& bottom_blob, Mat& top_blob,
                         kptr += maxk;
                     }
 
-                    outptr[j] = sum;
+                    outptr[j] = activate(sum, g * num_output_g + p);
                 }
 
                 outptr += outw;
+                flag += outw;
             }
         }
     }
 
+    free(cached_map);
+
     log_time_end("convdepthwise_cached");
 
     return 0;
@@ -40,8 +40,15 @@ public:
     virtual int forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const;
     virtual int forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const;
     virtual bool needs_cache() const {return true;}
+
+protected:
+    // border the input, serve the reused pixels from the cache and flag the
+    // ones left to compute in cached_map (caller frees it)
+    // returns 0 when flagged pixels remain, 1 when top_blob is complete,
+    // 2 when the whole frame should be recomputed, or a negative error
+    int prepare_cached(const Mat& bottom_blob, Mat& bottom_blob_bordered, Mat& top_blob, MRect& mrect, const Mat& cached_blob, bool*& cached_map) const;
 #endif
-    
+
 public:
     int group;
 };
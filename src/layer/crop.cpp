@@ -82,4 +82,19 @@ int Crop::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
     return 0;
 }
 
+int Crop::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.size() < 2 || top_shapes.empty())
+        return -1;
+
+    const MatShape& bottom_shape = bottom_shapes[0];
+    const MatShape& reference_shape = bottom_shapes[1];
+    if (bottom_shape.dims == 0 || reference_shape.dims == 0)
+        return -1;
+
+    top_shapes[0] = MatShape(reference_shape.w, reference_shape.h, bottom_shape.c);
+
+    return 0;
+}
+
 } // namespace ncnn
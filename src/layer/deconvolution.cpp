@@ -345,4 +345,265 @@ int Deconvolution::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+#if NCNN_CNNCACHE
+int Deconvolution::forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const
+{
+    const int kernel_extent = dilation * (kernel_size - 1) + 1;
+    top_mrect.forward_in_deconv(bottom_mrect, pad, kernel_extent, stride);
+    top_mrect.guard_warp();
+    return 0;
+}
+
+int Deconvolution::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
+{
+    if (cached_blob.empty()) {
+        return forward(bottom_blob, top_blob);
+    }
+
+    log_time_begin();
+
+    const int kernel_extent = dilation * (kernel_size - 1) + 1;
+    const int crop = pad > 0 ? pad : 0;
+
+    int outw = (bottom_blob.w - 1) * stride + kernel_extent - 2 * crop;
+    int outh = (bottom_blob.h - 1) * stride + kernel_extent - 2 * crop;
+
+    if (outw <= 5 || outh <= 5) {
+        return forward(bottom_blob, top_blob);
+    }
+
+    if (cached_blob.w != outw || cached_blob.h != outh || cached_blob.c != num_output
+        || mrect.full_changed(outw, outh)) {
+        return forward(bottom_blob, top_blob);
+    }
+
+    top_blob.create(outw, outh, num_output);
+    if (top_blob.empty())
+        return -100;
+
+    if (mrect.size() == 0 && !mrect.affine) {
+        memcpy(top_blob.data, cached_blob.data, cached_blob.total() * sizeof(float));
+        log_time_end("deconv_cached");
+        return 0;
+    }
+
+    bool* changed_map = (bool*) malloc(outh * outw * sizeof(bool));
+    if (!changed_map)
+        return -100;
+
+    mrect.build_changed_map(changed_map, outw, outh);
+
+    if (mrect.affine)
+        mrect.warp_cached(cached_blob, top_blob, changed_map);
+    else
+        mrect.copy_cached(cached_blob, top_blob);
+
+    int ret = forward_gemm_changed(bottom_blob, top_blob, changed_map);
+
+    free(changed_map);
+
+    if (mrect.affine)
+        log_time_end("deconv_cached_warp");
+    else
+        log_time_end("deconv_cached");
+
+    return ret;
+}
+
+int Deconvolution::forward_gemm_changed(const Mat& bottom_blob, Mat& top_blob, const bool* changed_map) const
+{
+    const int w = bottom_blob.w;
+    const int h = bottom_blob.h;
+    const int channels = bottom_blob.c;
+    const int outw = top_blob.w;
+    const int outh = top_blob.h;
+    const int crop = pad > 0 ? pad : 0;
+
+    const int maxk = kernel_size * kernel_size;
+
+    const float* weight_data_ptr = weight_data;
+    const float* bias_data_ptr = bias_term ? (const float*)bias_data : 0;
+
+    // output (x, y) gets tap (kx, ky) from input ((x + crop - kx * dilation) / stride, ...)
+    // only when that divides exactly, so every stride phase of the output
+    // sees a fixed subset of taps and is a plain gemm over those
+    for (int py = 0; py < stride; py++)
+    {
+        for (int px = 0; px < stride; px++)
+        {
+            std::vector<int> taps_x;
+            std::vector<int> taps_y;
+            for (int ky = 0; ky < kernel_size; ky++)
+            {
+                if ((py + stride * kernel_size * dilation - ky * dilation) % stride != 0)
+                    continue;
+                for (int kx = 0; kx < kernel_size; kx++)
+                {
+                    if ((px + stride * kernel_size * dilation - kx * dilation) % stride != 0)
+                        continue;
+                    taps_x.push_back(kx);
+                    taps_y.push_back(ky);
+                }
+            }
+            const int ntaps = taps_x.size();
+
+            // compacted list of the output positions of this phase to recompute
+            std::vector<int> positions;
+            for (int y = (py - crop % stride + stride) % stride; y < outh; y += stride)
+            {
+                for (int x = (px - crop % stride + stride) % stride; x < outw; x += stride)
+                {
+                    if (changed_map[y * outw + x])
+                        positions.push_back(y * outw + x);
+                }
+            }
+
+            const int count = positions.size();
+            if (count == 0)
+                continue;
+
+            // gemm M = num_output, K = channels * ntaps, N = count
+            const int K = channels * ntaps;
+            std::vector<float> _kernel(num_output * K + 1);
+            float* kernel = &_kernel[0];
+            for (int p = 0; p < num_output; p++)
+            {
+                for (int q = 0; q < channels; q++)
+                {
+                    const float* kptr = weight_data_ptr + maxk * (channels * p + q);
+                    for (int t = 0; t < ntaps; t++)
+                        kernel[K * p + ntaps * q + t] = kptr[taps_y[t] * kernel_size + taps_x[t]];
+                }
+            }
+
+            const int tile = 64;
+            const int tile_count = (count + tile - 1) / tile;
+
+            #pragma omp parallel for
+            for (int t = 0; t < tile_count; t++)
+            {
+                const int n0 = t * tile;
+                const int nn = std::min(tile, count - n0);
+
+                // packed input rows, zero where a tap falls outside the input
+                std::vector<float> _col(K * tile + 1);
+                float* col = &_col[0];
+                for (int n = 0; n < nn; n++)
+                {
+                    const int pos = positions[n0 + n];
+                    const int y = pos / outw + crop;
+                    const int x = pos % outw + crop;
+
+                    float* colptr = col + n;
+                    for (int q = 0; q < channels; q++)
+                    {
+                        const float* sptr = bottom_blob.channel(q);
+
+                        for (int k = 0; k < ntaps; k++)
+                        {
+                            const int sy = y - taps_y[k] * dilation;
+                            const int sx = x - taps_x[k] * dilation;
+                            const int iy = sy / stride;
+                            const int ix = sx / stride;
+                            bool inside = sy >= 0 && sx >= 0 && iy < h && ix < w;
+                            *colptr = inside ? sptr[iy * w + ix] : 0.f;
+                            colptr += tile;
+                        }
+                    }
+                }
+
+                float sum[4][tile];
+                int p = 0;
+                for (; p + 3 < num_output; p += 4)
+                {
+                    for (int r = 0; r < 4; r++)
+                    {
+                        const float bias0 = bias_data_ptr ? bias_data_ptr[p + r] : 0.f;
+                        for (int n = 0; n < nn; n++)
+                            sum[r][n] = bias0;
+                    }
+
+                    const float* kptr0 = kernel + K * p;
+                    const float* kptr1 = kptr0 + K;
+                    const float* kptr2 = kptr1 + K;
+                    const float* kptr3 = kptr2 + K;
+
+                    for (int k = 0; k < K; k++)
+                    {
+                        const float* colptr = col + k * tile;
+                        const float k0 = kptr0[k];
+                        const float k1 = kptr1[k];
+                        const float k2 = kptr2[k];
+                        const float k3 = kptr3[k];
+
+                        for (int n = 0; n < nn; n++)
+                        {
+                            sum[0][n] += k0 * colptr[n];
+                            sum[1][n] += k1 * colptr[n];
+                            sum[2][n] += k2 * colptr[n];
+                            sum[3][n] += k3 * colptr[n];
+                        }
+                    }
+
+                    // scatter
+                    for (int r = 0; r < 4; r++)
+                    {
+                        float* outptr = top_blob.channel(p + r);
+                        for (int n = 0; n < nn; n++)
+                            outptr[ positions[n0 + n] ] = sum[r][n];
+                    }
+                }
+
+                for (; p < num_output; p++)
+                {
+                    const float bias0 = bias_data_ptr ? bias_data_ptr[p] : 0.f;
+                    for (int n = 0; n < nn; n++)
+                        sum[0][n] = bias0;
+
+                    const float* kptr = kernel + K * p;
+                    for (int k = 0; k < K; k++)
+                    {
+                        const float* colptr = col + k * tile;
+                        const float k0 = kptr[k];
+
+                        for (int n = 0; n < nn; n++)
+                            sum[0][n] += k0 * colptr[n];
+                    }
+
+                    float* outptr = top_blob.channel(p);
+                    for (int n = 0; n < nn; n++)
+                        outptr[ positions[n0 + n] ] = sum[0][n];
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
+int Deconvolution::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    const int kernel_extent = dilation * (kernel_size - 1) + 1;
+
+    int outw = (bottom_shape.w - 1) * stride + kernel_extent;
+    int outh = (bottom_shape.h - 1) * stride + kernel_extent;
+
+    if (pad > 0)
+    {
+        outw -= pad * 2;
+        outh -= pad * 2;
+    }
+
+    if (outw <= 0 || outh <= 0)
+        return -1;
+
+    top_shape = MatShape(outw, outh, num_output);
+
+    return 0;
+}
+
 } // namespace ncnn
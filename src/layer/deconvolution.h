@@ -37,6 +37,18 @@ public:
 
     virtual int forward(const Mat& bottom_blobs, Mat& top_blobs) const;
 
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
+#if NCNN_CNNCACHE
+    virtual int forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const;
+    virtual int forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const;
+    virtual bool needs_cache() const {return true;}
+
+protected:
+    // recompute the flagged pixels of top_blob, one packed gemm per stride phase
+    int forward_gemm_changed(const Mat& bottom_blob, Mat& top_blob, const bool* changed_map) const;
+#endif
+
 public:
     // param
     int num_output;
@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "eltwise.h"
+#include "threadpool.h"
 #include <algorithm>
 
 namespace ncnn {
@@ -104,8 +105,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
     {
         // first blob
         const Mat& bottom_blob1 = bottom_blobs[1];
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             const float* ptr1 = bottom_blob1.channel(q);
@@ -115,13 +115,12 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
             {
                 outptr[i] = ptr[i] * ptr1[i];
             }
-        }
+        });
 
         for (size_t b=2; b<bottom_blobs.size(); b++)
         {
             const Mat& bottom_blob1 = bottom_blobs[b];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob1.channel(q);
                 float* outptr = top_blob.channel(q);
@@ -130,7 +129,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
                 {
                     outptr[i] *= ptr[i];
                 }
-            }
+            });
         }
     }
     else if (op_type == Operation_SUM)
@@ -139,8 +138,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
         {
             // first blob
             const Mat& bottom_blob1 = bottom_blobs[1];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob.channel(q);
                 const float* ptr1 = bottom_blob1.channel(q);
@@ -150,13 +148,12 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
                 {
                     outptr[i] = ptr[i] + ptr1[i];
                 }
-            }
+            });
 
             for (size_t b=2; b<bottom_blobs.size(); b++)
             {
                 const Mat& bottom_blob1 = bottom_blobs[b];
-                #pragma omp parallel for
-                for (int q=0; q<channels; q++)
+                parallel_for(0, channels, [&](int q)
                 {
                     const float* ptr = bottom_blob1.channel(q);
                     float* outptr = top_blob.channel(q);
@@ -165,7 +162,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
                     {
                         outptr[i] += ptr[i];
                     }
-                }
+                });
             }
         }
         else
@@ -176,8 +173,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
             const Mat& bottom_blob1 = bottom_blobs[1];
             float coeff0 = coeffs_ptr[0];
             float coeff1 = coeffs_ptr[1];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob.channel(q);
                 const float* ptr1 = bottom_blob1.channel(q);
@@ -187,14 +183,13 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
                 {
                     outptr[i] = ptr[i] * coeff0 + ptr1[i] * coeff1;
                 }
-            }
+            });
 
             for (size_t b=2; b<bottom_blobs.size(); b++)
             {
                 const Mat& bottom_blob1 = bottom_blobs[b];
                 float coeff = coeffs_ptr[b];
-                #pragma omp parallel for
-                for (int q=0; q<channels; q++)
+                parallel_for(0, channels, [&](int q)
                 {
                     const float* ptr = bottom_blob1.channel(q);
                     float* outptr = top_blob.channel(q);
@@ -203,7 +198,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
                     {
                         outptr[i] += ptr[i] * coeff;
                     }
-                }
+                });
             }
         }
     }
@@ -211,8 +206,7 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
     {
         // first blob
         const Mat& bottom_blob1 = bottom_blobs[1];
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             const float* ptr1 = bottom_blob1.channel(q);
@@ -222,13 +216,12 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
             {
                 outptr[i] = std::max(ptr[i], ptr1[i]);
             }
-        }
+        });
 
         for (size_t b=2; b<bottom_blobs.size(); b++)
         {
             const Mat& bottom_blob1 = bottom_blobs[b];
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob1.channel(q);
                 float* outptr = top_blob.channel(q);
@@ -237,11 +230,59 @@ int Eltwise::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top
                 {
                     outptr[i] = std::max(outptr[i], ptr[i]);
                 }
-            }
+            });
         }
     }
 
     return 0;
 }
 
+#if NCNN_CNNCACHE
+int Eltwise::forward_cached(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, MRect& mrect, Mat& cached_blob) const
+{
+    std::vector<struct rect> rects;
+    if (!mrect.reuse_elementwise(bottom_blobs[0], cached_blob, top_blobs[0], rects))
+        return forward(bottom_blobs, top_blobs);
+
+    Mat& top_blob = top_blobs[0];
+    int channels = top_blob.c;
+    const float* coeffs_ptr = num_coeff ? (const float*)coeffs : 0;
+
+    // changed region only, the rest came from the cache
+    parallel_for(0, channels, [&](int q)
+    {
+        Mat out = top_blob.channel(q);
+
+        for (size_t i=0; i<rects.size(); i++)
+        {
+            const struct rect& r = rects[i];
+            for (int y=r.y1; y<=r.y2; y++)
+            {
+                float* outptr = out.row(y);
+
+                for (size_t b=0; b<bottom_blobs.size(); b++)
+                {
+                    const float* ptr = bottom_blobs[b].channel(q).row(y);
+                    float coeff = coeffs_ptr ? coeffs_ptr[b] : 1.f;
+
+                    for (int x=r.x1; x<=r.x2; x++)
+                    {
+                        if (b == 0)
+                            outptr[x] = op_type == Operation_SUM && coeffs_ptr ? ptr[x] * coeff : ptr[x];
+                        else if (op_type == Operation_PROD)
+                            outptr[x] *= ptr[x];
+                        else if (op_type == Operation_SUM)
+                            outptr[x] += coeffs_ptr ? ptr[x] * coeff : ptr[x];
+                        else
+                            outptr[x] = std::max(outptr[x], ptr[x]);
+                    }
+                }
+            }
+        }
+    });
+
+    return 0;
+}
+#endif
+
 } // namespace ncnn
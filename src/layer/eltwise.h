@@ -34,6 +34,11 @@ public:
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
 
+#if NCNN_CNNCACHE
+    virtual int forward_cached(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, MRect& mrect, Mat& cached_blob) const;
+    virtual bool needs_cache() const {return true;}
+#endif
+
     enum { Operation_PROD = 0, Operation_SUM = 1, Operation_MAX = 2 };
 
 public:
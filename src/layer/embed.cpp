@@ -238,4 +238,14 @@ int Embed::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int Embed::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    top_shape = MatShape(num_output, bottom_shape.w * bottom_shape.h * bottom_shape.c, 1);
+
+    return 0;
+}
+
 } // namespace ncnn
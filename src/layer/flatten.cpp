@@ -50,4 +50,14 @@ int Flatten::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int Flatten::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    top_shape = MatShape(bottom_shape.w * bottom_shape.h * bottom_shape.c);
+
+    return 0;
+}
+
 } // namespace ncnn
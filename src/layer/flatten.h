@@ -25,6 +25,8 @@ public:
     Flatten();
 
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
+
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
 };
 
 } // namespace ncnn
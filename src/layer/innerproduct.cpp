@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "innerproduct.h"
+#include "threadpool.h"
 
 namespace ncnn {
 
@@ -243,8 +244,7 @@ int InnerProduct::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     // num_output
     const float* weight_data_ptr = weight_data;
-    #pragma omp parallel for
-    for (int p=0; p<num_output; p++)
+    parallel_for(0, num_output, [&](int p)
     {
         float* outptr = top_blob.channel(p);
         float sum = 0.f;
@@ -265,8 +265,105 @@ int InnerProduct::forward(const Mat& bottom_blob, Mat& top_blob) const
         }
 
         outptr[0] = sum;
+    });
+
+    return 0;
+}
+
+int InnerProduct::forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    const int batch = bottom_blobs.size();
+    for (int n=1; n<batch; n++)
+    {
+        if (bottom_blobs[n].w != bottom_blobs[0].w || bottom_blobs[n].h != bottom_blobs[0].h || bottom_blobs[n].c != bottom_blobs[0].c)
+            return Layer::forward_batch(bottom_blobs, top_blobs);
+    }
+
+    if (batch == 0)
+    {
+        top_blobs.clear();
+        return 0;
+    }
+
+    int w = bottom_blobs[0].w;
+    int h = bottom_blobs[0].h;
+    int channels = bottom_blobs[0].c;
+    int size = w * h;
+
+    top_blobs.resize(batch);
+    for (int n=0; n<batch; n++)
+    {
+        top_blobs[n].create(1, 1, num_output);
+        if (top_blobs[n].empty())
+            return -100;
     }
 
+    // num_output, each weight is loaded once for four samples
+    const float* weight_data_ptr = weight_data;
+    parallel_for(0, num_output, [&](int p)
+    {
+        const float bias = bias_term ? bias_data.data[p] : 0.f;
+
+        int n = 0;
+        for (; n+3<batch; n+=4)
+        {
+            float sum0 = bias;
+            float sum1 = bias;
+            float sum2 = bias;
+            float sum3 = bias;
+
+            // channels
+            for (int q=0; q<channels; q++)
+            {
+                const float* w = weight_data_ptr + size * channels * p + size * q;
+                const float* m0 = bottom_blobs[n].channel(q);
+                const float* m1 = bottom_blobs[n+1].channel(q);
+                const float* m2 = bottom_blobs[n+2].channel(q);
+                const float* m3 = bottom_blobs[n+3].channel(q);
+
+                for (int i = 0; i < size; i++)
+                {
+                    sum0 += m0[i] * w[i];
+                    sum1 += m1[i] * w[i];
+                    sum2 += m2[i] * w[i];
+                    sum3 += m3[i] * w[i];
+                }
+            }
+
+            top_blobs[n].channel(p)[0] = sum0;
+            top_blobs[n+1].channel(p)[0] = sum1;
+            top_blobs[n+2].channel(p)[0] = sum2;
+            top_blobs[n+3].channel(p)[0] = sum3;
+        }
+        for (; n<batch; n++)
+        {
+            float sum = bias;
+
+            for (int q=0; q<channels; q++)
+            {
+                const float* w = weight_data_ptr + size * channels * p + size * q;
+                const float* m = bottom_blobs[n].channel(q);
+
+                for (int i = 0; i < size; i++)
+                {
+                    sum += m[i] * w[i];
+                }
+            }
+
+            top_blobs[n].channel(p)[0] = sum;
+        }
+    });
+
+    return 0;
+}
+
+int InnerProduct::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    top_shape = MatShape(1, 1, num_output);
+
     return 0;
 }
 
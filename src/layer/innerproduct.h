@@ -37,6 +37,10 @@ public:
 
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
 
+    virtual int forward_batch(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
+
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
 public:
     // param
     int num_output;
@@ -75,4 +75,19 @@ int Input::forward_inplace(Mat& /*bottom_top_blob*/) const
     return 0;
 }
 
+int Input::infer_shape(const MatShape& /*bottom_shape*/, MatShape& top_shape) const
+{
+    // size is c h w, unused trailing dims are -233
+    if (size[0] > 0 && size[1] > 0 && size[2] > 0)
+        top_shape = MatShape(size[2], size[1], size[0]);
+    else if (size[0] > 0 && size[1] > 0)
+        top_shape = MatShape(size[1], size[0]);
+    else if (size[0] > 0)
+        top_shape = MatShape(size[0]);
+    else
+        return -1;
+
+    return 0;
+}
+
 } // namespace ncnn
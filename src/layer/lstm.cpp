@@ -23,6 +23,7 @@ LSTM::LSTM()
 {
     one_blob_only = false;
     support_inplace = false;
+    support_stateful = true;
 }
 
 LSTM::~LSTM()
@@ -122,6 +123,13 @@ int LSTM::load_model(const unsigned char*& mem)
 }
 
 int LSTM::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    // start from zero hidden and cell state
+    std::vector<Mat> states;
+    return forward_stateful(bottom_blobs, top_blobs, states);
+}
+
+int LSTM::forward_stateful(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, std::vector<Mat>& states) const
 {
     // size x 1 x T
     const Mat& input_blob = bottom_blobs[0];
@@ -132,16 +140,21 @@ int LSTM::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
     int T = input_blob.c;
     int size = input_blob.w;
 
-    // initial hidden state
-    Mat hidden(num_output);
-    if (hidden.empty())
-        return -100;
-    hidden.fill(0.f);
+    // hidden and internal cell state, carried over from the last call
+    if (states.size() != 2 || states[0].w != num_output || states[1].w != num_output)
+    {
+        states.resize(2);
+        states[0].create(num_output);
+        states[1].create(num_output);
+        if (states[0].empty() || states[1].empty())
+            return -100;
+        states[0].fill(0.f);
+        states[1].fill(0.f);
+    }
+
+    Mat& hidden = states[0];
+    Mat& cell = states[1];
 
-    // internal cell state
-    Mat cell(num_output);
-    if (cell.empty())
-        return -100;
     // 4 x num_output
     Mat gates(4, num_output);
     if (gates.empty())
@@ -220,7 +233,7 @@ int LSTM::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
             float G = gates_data[3];
 
             I = 1.f / (1.f + exp(-I));
-            F = cont ? 0.f : 1.f / (1.f + exp(-F));
+            F = cont ? 1.f / (1.f + exp(-F)) : 0.f;
             O = 1.f / (1.f + exp(-O));
             G = tanh(G);
 
@@ -238,4 +251,17 @@ int LSTM::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_bl
     return 0;
 }
 
+int LSTM::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.empty() || bottom_shapes[0].dims == 0 || top_shapes.empty())
+        return -1;
+
+    // size x 1 x T
+    int T = bottom_shapes[0].c;
+
+    top_shapes[0] = MatShape(num_output, 1, T);
+
+    return 0;
+}
+
 } // namespace ncnn
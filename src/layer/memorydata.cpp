@@ -75,4 +75,14 @@ int MemoryData::forward_inplace(Mat& /*bottom_top_blob*/) const
     return 0;
 }
 
+int MemoryData::infer_shape(const MatShape& /*bottom_shape*/, MatShape& top_shape) const
+{
+    if (width <= 0 || height <= 0 || channels <= 0)
+        return -1;
+
+    top_shape = MatShape(width, height, channels);
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -34,6 +34,8 @@ public:
 
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
 
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
     virtual int forward_inplace(Mat& bottom_top_blob) const;
 
 public:
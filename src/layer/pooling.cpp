@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "pooling.h"
+#include "threadpool.h"
 #include <algorithm>
 
 namespace ncnn {
@@ -96,8 +97,7 @@ int Pooling::forward(const Mat& bottom_blob, Mat& top_blob) const
 
         if (pooling_type == PoolMethod_MAX)
         {
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob.channel(q);
                 float* outptr = top_blob.channel(q);
@@ -109,12 +109,11 @@ int Pooling::forward(const Mat& bottom_blob, Mat& top_blob) const
                 }
 
                 outptr[0] = max;
-            }
+            });
         }
         else if (pooling_type == PoolMethod_AVE)
         {
-            #pragma omp parallel for
-            for (int q=0; q<channels; q++)
+            parallel_for(0, channels, [&](int q)
             {
                 const float* ptr = bottom_blob.channel(q);
                 float* outptr = top_blob.channel(q);
@@ -126,7 +125,7 @@ int Pooling::forward(const Mat& bottom_blob, Mat& top_blob) const
                 }
 
                 outptr[0] = sum / size;
-            }
+            });
         }
 
         return 0;
@@ -221,8 +220,7 @@ int Pooling::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     if (pooling_type == PoolMethod_MAX)
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const Mat m(w, h, bottom_blob_bordered.channel(q));
             float* outptr = top_blob.channel(q);
@@ -246,12 +244,11 @@ int Pooling::forward(const Mat& bottom_blob, Mat& top_blob) const
 
                 outptr += outw;
             }
-        }
+        });
     }
     else if (pooling_type == PoolMethod_AVE)
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const Mat m(w, h, bottom_blob_bordered.channel(q));
             float* outptr = top_blob.channel(q);
@@ -298,7 +295,7 @@ int Pooling::forward(const Mat& bottom_blob, Mat& top_blob) const
                     outptr[i] *= scale;
                 }
             }
-        }
+        });
     }
 
     return 0;
@@ -313,4 +310,53 @@ int Pooling::forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const
 }
 #endif
 
+int Pooling::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    if (global_pooling)
+    {
+        top_shape = MatShape(1, 1, bottom_shape.c);
+        return 0;
+    }
+
+    int w = bottom_shape.w;
+    int h = bottom_shape.h;
+
+    if (pad > 0)
+    {
+        w += pad * 2;
+        h += pad * 2;
+    }
+    else if (pad == -233)
+    {
+        int wpad = kernel_size + (w - 1) / stride * stride - w;
+        int hpad = kernel_size + (h - 1) / stride * stride - h;
+        if (wpad > 0 || hpad > 0)
+        {
+            w += wpad;
+            h += hpad;
+        }
+    }
+
+    int outw = (w - kernel_size) / stride + 1;
+    int outh = (h - kernel_size) / stride + 1;
+    if (outw <= 0 || outh <= 0)
+        return -1;
+
+    // forward pads the tail so the last window is kept
+    if (pad != -233)
+    {
+        if ((w - kernel_size) % stride != 0)
+            outw += 1;
+        if ((h - kernel_size) % stride != 0)
+            outh += 1;
+    }
+
+    top_shape = MatShape(outw, outh, bottom_shape.c);
+
+    return 0;
+}
+
 } // namespace ncnn
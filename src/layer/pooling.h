@@ -34,6 +34,8 @@ public:
 
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
 
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
 #if NCNN_CNNCACHE
     virtual int forward_mrect(MRect& bottom_mrect, MRect& top_mrect) const;
 #endif
@@ -38,6 +38,11 @@ public:
 
     virtual int forward_inplace(Mat& bottom_top_blob) const;
 
+#if NCNN_CNNCACHE
+    virtual int forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const;
+    virtual bool needs_cache() const {return true;}
+#endif
+
 public:
     int num_slope;
     Mat slope_data;
@@ -349,4 +349,10 @@ int Proposal::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& to
     return 0;
 }
 
+int Proposal::infer_shape(const std::vector<MatShape>& /*bottom_shapes*/, std::vector<MatShape>& /*top_shapes*/) const
+{
+    // roi count depends on the scores after nms
+    return -1;
+}
+
 } // namespace ncnn
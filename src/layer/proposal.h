@@ -34,6 +34,8 @@ public:
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
 
+    virtual int infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const;
+
 public:
     // param
     int feat_stride;
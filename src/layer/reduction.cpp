@@ -948,4 +948,25 @@ int Reduction::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int Reduction::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    if (dim == 0)
+        top_shape = MatShape(1);
+    else if (dim == 1)
+        top_shape = MatShape(bottom_shape.c);
+    else if (dim == 2)
+        top_shape = MatShape(bottom_shape.h, bottom_shape.c);
+    else if (dim == -1)
+        top_shape = MatShape(bottom_shape.w);
+    else if (dim == -2)
+        top_shape = MatShape(bottom_shape.w, bottom_shape.h);
+    else
+        return -1;
+
+    return 0;
+}
+
 } // namespace ncnn
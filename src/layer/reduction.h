@@ -35,6 +35,8 @@ public:
 
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
 
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
     enum {
         ReductionOp_SUM     = 0,
         ReductionOp_ASUM    = 1,
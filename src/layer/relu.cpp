@@ -13,6 +13,7 @@
 // specific language governing permissions and limitations under the License.
 
 #include "relu.h"
+#include "threadpool.h"
 
 namespace ncnn {
 
@@ -67,8 +68,7 @@ int ReLU::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     if (slope == 0.f)
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             float* outptr = top_blob.channel(q);
@@ -80,12 +80,11 @@ int ReLU::forward(const Mat& bottom_blob, Mat& top_blob) const
                 else
                     outptr[i] = ptr[i];
             }
-        }
+        });
     }
     else
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             const float* ptr = bottom_blob.channel(q);
             float* outptr = top_blob.channel(q);
@@ -93,11 +92,11 @@ int ReLU::forward(const Mat& bottom_blob, Mat& top_blob) const
             for (int i=0; i<size; i++)
             {
                 if (ptr[i] < 0)
-                    outptr[i] *= slope;
+                    outptr[i] = ptr[i] * slope;
                 else
                     outptr[i] = ptr[i];
             }
-        }
+        });
     }
 
     return 0;
@@ -112,8 +111,7 @@ int ReLU::forward_inplace(Mat& bottom_top_blob) const
 
     if (slope == 0.f)
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             float* ptr = bottom_top_blob.channel(q);
 
@@ -122,12 +120,11 @@ int ReLU::forward_inplace(Mat& bottom_top_blob) const
                 if (ptr[i] < 0)
                     ptr[i] = 0;
             }
-        }
+        });
     }
     else
     {
-        #pragma omp parallel for
-        for (int q=0; q<channels; q++)
+        parallel_for(0, channels, [&](int q)
         {
             float* ptr = bottom_top_blob.channel(q);
 
@@ -136,10 +133,48 @@ int ReLU::forward_inplace(Mat& bottom_top_blob) const
                 if (ptr[i] < 0)
                     ptr[i] *= slope;
             }
-        }
+        });
     }
 
     return 0;
 }
 
+#if NCNN_CNNCACHE
+int ReLU::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
+{
+    std::vector<struct rect> rects;
+    if (!mrect.reuse_elementwise(bottom_blob, cached_blob, top_blob, rects))
+        return forward(bottom_blob, top_blob);
+
+    int channels = bottom_blob.c;
+
+    // changed region only, the rest came from the cache
+    parallel_for(0, channels, [&](int q)
+    {
+        const Mat m = bottom_blob.channel(q);
+        Mat out = top_blob.channel(q);
+
+        for (size_t i=0; i<rects.size(); i++)
+        {
+            const struct rect& r = rects[i];
+            for (int y=r.y1; y<=r.y2; y++)
+            {
+                const float* ptr = m.row(y);
+                float* outptr = out.row(y);
+
+                for (int x=r.x1; x<=r.x2; x++)
+                {
+                    if (ptr[x] < 0)
+                        outptr[x] = slope == 0.f ? 0.f : ptr[x] * slope;
+                    else
+                        outptr[x] = ptr[x];
+                }
+            }
+        }
+    });
+
+    return 0;
+}
+#endif
+
 } // namespace ncnn
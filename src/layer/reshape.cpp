@@ -179,4 +179,74 @@ int Reshape::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int Reshape::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    int total = bottom_shape.w * bottom_shape.h * bottom_shape.c;
+
+    if (ndim == 1)
+    {
+        int _w = w;
+
+        if (_w == 0)
+            _w = bottom_shape.w;
+
+        if (_w == -1)
+            _w = total;
+
+        top_shape = MatShape(_w);
+    }
+    else if (ndim == 2)
+    {
+        int _w = w;
+        int _h = h;
+
+        if (_w == 0)
+            _w = bottom_shape.w;
+        if (_h == 0)
+            _h = bottom_shape.h;
+
+        if (_w == -1)
+            _w = total / _h;
+        if (_h == -1)
+            _h = total / _w;
+
+        top_shape = MatShape(_w, _h);
+    }
+    else if (ndim == 3)
+    {
+        int _w = w;
+        int _h = h;
+        int _c = c;
+
+        if (_w == 0)
+            _w = bottom_shape.w;
+        if (_h == 0)
+            _h = bottom_shape.h;
+        if (_c == 0)
+            _c = bottom_shape.c;
+
+        if (_w == -1)
+            _w = total / _c / _h;
+        if (_h == -1)
+            _h = total / _c / _w;
+        if (_c == -1)
+            _c = total / _h / _w;
+
+        top_shape = MatShape(_w, _h, _c);
+    }
+    else
+    {
+        return -1;
+    }
+
+    // Mat::reshape refuses a different element count
+    if (top_shape.w * top_shape.h * top_shape.c != total)
+        return -1;
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -23,6 +23,7 @@ RNN::RNN()
 {
     one_blob_only = false;
     support_inplace = false;
+    support_stateful = true;
 }
 
 RNN::~RNN()
@@ -148,6 +149,13 @@ int RNN::load_model(const unsigned char*& mem)
 }
 
 int RNN::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const
+{
+    // start from zero hidden state
+    std::vector<Mat> states;
+    return forward_stateful(bottom_blobs, top_blobs, states);
+}
+
+int RNN::forward_stateful(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, std::vector<Mat>& states) const
 {
     // size x 1 x T
     const Mat& input_blob = bottom_blobs[0];
@@ -158,11 +166,17 @@ int RNN::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blo
     int T = input_blob.c;
     int size = input_blob.w;
 
-    // initial hidden state
-    Mat hidden(num_output);
-    if (hidden.empty())
-        return -100;
-    hidden.fill(0.f);
+    // hidden state, carried over from the last call
+    if (states.size() != 1 || states[0].w != num_output)
+    {
+        states.resize(1);
+        states[0].create(num_output);
+        if (states[0].empty())
+            return -100;
+        states[0].fill(0.f);
+    }
+
+    Mat& hidden = states[0];
 
     Mat& top_blob = top_blobs[0];
     top_blob.create(num_output, 1, T);
@@ -221,4 +235,17 @@ int RNN::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blo
     return 0;
 }
 
+int RNN::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.empty() || bottom_shapes[0].dims == 0 || top_shapes.empty())
+        return -1;
+
+    // size x 1 x T
+    int T = bottom_shapes[0].c;
+
+    top_shapes[0] = MatShape(num_output, 1, T);
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -37,6 +37,10 @@ public:
 
     virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs) const;
 
+    virtual int infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const;
+
+    virtual int forward_stateful(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, std::vector<Mat>& states) const;
+
 public:
     // param
     int num_output;
@@ -141,4 +141,14 @@ int ROIPooling::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>&
     return 0;
 }
 
+int ROIPooling::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.empty() || bottom_shapes[0].dims == 0 || top_shapes.empty())
+        return -1;
+
+    top_shapes[0] = MatShape(pooled_width, pooled_height, bottom_shapes[0].c);
+
+    return 0;
+}
+
 } // namespace ncnn
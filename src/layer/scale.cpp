@@ -201,4 +201,42 @@ int Scale::forward_inplace(Mat& bottom_top_blob) const
     return 0;
 }
 
+#if NCNN_CNNCACHE
+int Scale::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
+{
+    std::vector<struct rect> rects;
+    if (!mrect.reuse_elementwise(bottom_blob, cached_blob, top_blob, rects))
+        return forward(bottom_blob, top_blob);
+
+    int channels = bottom_blob.c;
+
+    // changed region only, the rest came from the cache
+    #pragma omp parallel for
+    for (int q=0; q<channels; q++)
+    {
+        const Mat m = bottom_blob.channel(q);
+        Mat out = top_blob.channel(q);
+        float s = scale_data[q];
+        float bias = bias_term ? bias_data[q] : 0.f;
+
+        for (size_t i=0; i<rects.size(); i++)
+        {
+            const struct rect& r = rects[i];
+            for (int y=r.y1; y<=r.y2; y++)
+            {
+                const float* ptr = m.row(y);
+                float* outptr = out.row(y);
+
+                for (int x=r.x1; x<=r.x2; x++)
+                {
+                    outptr[x] = ptr[x] * s + bias;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+#endif
+
 } // namespace ncnn
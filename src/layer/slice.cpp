@@ -112,4 +112,30 @@ int Slice::forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_b
     return 0;
 }
 
+int Slice::infer_shape(const std::vector<MatShape>& bottom_shapes, std::vector<MatShape>& top_shapes) const
+{
+    if (bottom_shapes.empty() || bottom_shapes[0].dims == 0)
+        return -1;
+
+    const MatShape& bottom_shape = bottom_shapes[0];
+    int channels = bottom_shape.c;
+
+    int q = 0;
+    const int* slices_ptr = (const int*)slices.data;
+    for (size_t i=0; i<top_shapes.size(); i++)
+    {
+        int slice = slices_ptr[i];
+        if (slice == -233)
+        {
+            slice = (channels - q) / (top_shapes.size() - i);
+        }
+
+        top_shapes[i] = MatShape(bottom_shape.w, bottom_shape.h, slice);
+
+        q += slice;
+    }
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -194,4 +194,15 @@ int SPP::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int SPP::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    int pyramid_num_bins = ((1 << (pyramid_height * 2)) - 1) / 3;
+    top_shape = MatShape(pyramid_num_bins, 1, 2);
+
+    return 0;
+}
+
 } // namespace ncnn
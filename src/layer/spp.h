@@ -34,6 +34,8 @@ public:
 
     virtual int forward(const Mat& bottom_blob, Mat& top_blob) const;
 
+    virtual int infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const;
+
     enum { PoolMethod_MAX = 0, PoolMethod_AVE = 1 };
 
 public:
@@ -142,4 +142,25 @@ int Tile::forward(const Mat& bottom_blob, Mat& top_blob) const
     return 0;
 }
 
+int Tile::infer_shape(const MatShape& bottom_shape, MatShape& top_shape) const
+{
+    if (bottom_shape.dims == 0)
+        return -1;
+
+    int w = bottom_shape.w;
+    int h = bottom_shape.h;
+    int channels = bottom_shape.c;
+
+    if (dim == 0)
+        top_shape = MatShape(w, h, channels * tiles);
+    else if (dim == 1)
+        top_shape = MatShape(w, h * tiles, channels);
+    else if (dim == 2)
+        top_shape = MatShape(w * tiles, h, channels);
+    else
+        return -1;
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -13,14 +13,29 @@
 // specific language governing permissions and limitations under the License.
 
 #include "convolution_x86.h"
+#include "threadpool.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 
 namespace ncnn {
 
 #include "convolution_3x3.h"
 #include "convolution_5x5.h"
+#include "convolution_pixels.h"
 
 DEFINE_LAYER_CREATOR(Convolution_x86)
 
+int Convolution_x86::forward_pixels(const unsigned char* pixels, int type, int w, int h,
+                                    const float* mean_vals, const float* norm_vals, Mat& top_blob) const
+{
+    if (!support_pixels(type))
+        return Layer::forward_pixels(pixels, type, w, h, mean_vals, norm_vals, top_blob);
+
+    return forward_pixels_s2(pixels, type, w, h, mean_vals, norm_vals, top_blob, conv_phase_rows_sse);
+}
+
 int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob) const
 {
     // convolv with NxN kernel
@@ -116,6 +131,8 @@ int Convolution_x86::forward(const Mat& bottom_blob, Mat& top_blob) const
 
     conv(bottom_blob_bordered, top_blob, weight_data, bias_data);
 
+    activate(top_blob);
+
     return 0;
 }
 
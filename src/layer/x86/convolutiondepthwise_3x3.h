@@ -0,0 +1,232 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#if NCNN_CNNCACHE
+// depth-wise kernels for the cached path
+// only the dirty spans of each row are computed, true in cached_map means recompute
+static void convdw3x3s1_sse_cached(const Mat& bottom_blob, Mat& top_blob, const Mat& _kernel, const Mat& _bias, const bool* cached_map)
+{
+    int w = bottom_blob.w;
+
+    int outw = top_blob.w;
+    int outh = top_blob.h;
+
+    const int group = bottom_blob.c;
+
+    const float* kernel = _kernel;
+    const float* bias = _bias;
+
+    #pragma omp parallel for
+    for (int g=0; g<group; g++)
+    {
+        Mat out = top_blob.channel(g);
+
+        const float bias0 = bias ? bias[g] : 0.f;
+
+        const float* kernel0 = kernel + g*9;
+
+        const float* img0 = bottom_blob.channel(g);
+
+#if __SSE2__
+        __m128 _k0 = _mm_set1_ps(kernel0[0]);
+        __m128 _k1 = _mm_set1_ps(kernel0[1]);
+        __m128 _k2 = _mm_set1_ps(kernel0[2]);
+        __m128 _k3 = _mm_set1_ps(kernel0[3]);
+        __m128 _k4 = _mm_set1_ps(kernel0[4]);
+        __m128 _k5 = _mm_set1_ps(kernel0[5]);
+        __m128 _k6 = _mm_set1_ps(kernel0[6]);
+        __m128 _k7 = _mm_set1_ps(kernel0[7]);
+        __m128 _k8 = _mm_set1_ps(kernel0[8]);
+        __m128 _bias0 = _mm_set1_ps(bias0);
+#endif // __SSE2__
+
+        for (int i = 0; i < outh; i++)
+        {
+            float* outptr = out.row(i);
+            const bool* flag = cached_map + i * outw;
+
+            const float* r0 = img0 + w * i;
+            const float* r1 = r0 + w;
+            const float* r2 = r1 + w;
+
+            int j = 0;
+            while (j < outw)
+            {
+                if (!flag[j])
+                {
+                    j++;
+                    continue;
+                }
+
+                int end = j + 1;
+                while (end < outw && flag[end])
+                    end++;
+
+#if __SSE2__
+                for (; j + 3 < end; j += 4)
+                {
+                    __m128 _sum = _bias0;
+
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r0 + j), _k0));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r0 + j + 1), _k1));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r0 + j + 2), _k2));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r1 + j), _k3));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r1 + j + 1), _k4));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r1 + j + 2), _k5));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r2 + j), _k6));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r2 + j + 1), _k7));
+                    _sum = _mm_add_ps(_sum, _mm_mul_ps(_mm_loadu_ps(r2 + j + 2), _k8));
+
+                    _mm_storeu_ps(outptr + j, _sum);
+                }
+#endif // __SSE2__
+                for (; j < end; j++)
+                {
+                    float sum = bias0;
+
+                    sum += r0[j] * kernel0[0];
+                    sum += r0[j + 1] * kernel0[1];
+                    sum += r0[j + 2] * kernel0[2];
+                    sum += r1[j] * kernel0[3];
+                    sum += r1[j + 1] * kernel0[4];
+                    sum += r1[j + 2] * kernel0[5];
+                    sum += r2[j] * kernel0[6];
+                    sum += r2[j + 1] * kernel0[7];
+                    sum += r2[j + 2] * kernel0[8];
+
+                    outptr[j] = sum;
+                }
+            }
+        }
+    }
+}
+
+static void convdw3x3s2_sse_cached(const Mat& bottom_blob, Mat& top_blob, const Mat& _kernel, const Mat& _bias, const bool* cached_map)
+{
+    int w = bottom_blob.w;
+
+    int outw = top_blob.w;
+    int outh = top_blob.h;
+
+    const int group = bottom_blob.c;
+
+    const float* kernel = _kernel;
+    const float* bias = _bias;
+
+    #pragma omp parallel for
+    for (int g=0; g<group; g++)
+    {
+        Mat out = top_blob.channel(g);
+
+        const float bias0 = bias ? bias[g] : 0.f;
+
+        const float* kernel0 = kernel + g*9;
+
+        const float* img0 = bottom_blob.channel(g);
+
+#if __SSE2__
+        __m128 _k0 = _mm_set1_ps(kernel0[0]);
+        __m128 _k1 = _mm_set1_ps(kernel0[1]);
+        __m128 _k2 = _mm_set1_ps(kernel0[2]);
+        __m128 _k3 = _mm_set1_ps(kernel0[3]);
+        __m128 _k4 = _mm_set1_ps(kernel0[4]);
+        __m128 _k5 = _mm_set1_ps(kernel0[5]);
+        __m128 _k6 = _mm_set1_ps(kernel0[6]);
+        __m128 _k7 = _mm_set1_ps(kernel0[7]);
+        __m128 _k8 = _mm_set1_ps(kernel0[8]);
+        __m128 _bias0 = _mm_set1_ps(bias0);
+#endif // __SSE2__
+
+        for (int i = 0; i < outh; i++)
+        {
+            float* outptr = out.row(i);
+            const bool* flag = cached_map + i * outw;
+
+            const float* r0 = img0 + w * i * 2;
+            const float* r1 = r0 + w;
+            const float* r2 = r1 + w;
+
+            int j = 0;
+            while (j < outw)
+            {
+                if (!flag[j])
+                {
+                    j++;
+                    continue;
+                }
+
+                int end = j + 1;
+                while (end < outw && flag[end])
+                    end++;
+
+#if __SSE2__
+                for (; j + 3 < end; j += 4)
+                {
+                    __m128 _sum = _bias0;
+
+                    const float* rows[3] = { r0 + j * 2, r1 + j * 2, r2 + j * 2 };
+                    const __m128* ks[3][3] = {
+                        { &_k0, &_k1, &_k2 },
+                        { &_k3, &_k4, &_k5 },
+                        { &_k6, &_k7, &_k8 }
+                    };
+
+                    for (int k = 0; k < 3; k++)
+                    {
+                        const float* p = rows[k];
+
+                        // p0 .. p7 deinterleaved to even p0 p2 p4 p6 and odd p1 p3 p5 p7
+                        __m128 _a = _mm_loadu_ps(p);
+                        __m128 _b = _mm_loadu_ps(p + 4);
+                        __m128 _even = _mm_shuffle_ps(_a, _b, _MM_SHUFFLE(2, 0, 2, 0));
+                        __m128 _odd = _mm_shuffle_ps(_a, _b, _MM_SHUFFLE(3, 1, 3, 1));
+
+                        // p2 p4 p6 p8
+                        __m128 _lo = _mm_shuffle_ps(_a, _b, _MM_SHUFFLE(0, 0, 2, 2));
+                        __m128 _hi = _mm_shuffle_ps(_b, _mm_load_ss(p + 8), _MM_SHUFFLE(0, 0, 2, 2));
+                        __m128 _next = _mm_shuffle_ps(_lo, _hi, _MM_SHUFFLE(2, 0, 2, 0));
+
+                        _sum = _mm_add_ps(_sum, _mm_mul_ps(_even, *ks[k][0]));
+                        _sum = _mm_add_ps(_sum, _mm_mul_ps(_odd, *ks[k][1]));
+                        _sum = _mm_add_ps(_sum, _mm_mul_ps(_next, *ks[k][2]));
+                    }
+
+                    _mm_storeu_ps(outptr + j, _sum);
+                }
+#endif // __SSE2__
+                for (; j < end; j++)
+                {
+                    const float* p0 = r0 + j * 2;
+                    const float* p1 = r1 + j * 2;
+                    const float* p2 = r2 + j * 2;
+
+                    float sum = bias0;
+
+                    sum += p0[0] * kernel0[0];
+                    sum += p0[1] * kernel0[1];
+                    sum += p0[2] * kernel0[2];
+                    sum += p1[0] * kernel0[3];
+                    sum += p1[1] * kernel0[4];
+                    sum += p1[2] * kernel0[5];
+                    sum += p2[0] * kernel0[6];
+                    sum += p2[1] * kernel0[7];
+                    sum += p2[2] * kernel0[8];
+
+                    outptr[j] = sum;
+                }
+            }
+        }
+    }
+}
+#endif // NCNN_CNNCACHE
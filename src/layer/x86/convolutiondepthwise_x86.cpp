@@ -0,0 +1,65 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "convolutiondepthwise_x86.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
+
+namespace ncnn {
+
+#include "convolutiondepthwise_3x3.h"
+
+DEFINE_LAYER_CREATOR(ConvolutionDepthWise_x86)
+
+#if NCNN_CNNCACHE
+int ConvolutionDepthWise_x86::forward_cached(const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob) const
+{
+    const int channels = bottom_blob.c;
+
+    if (kernel_size != 3 || dilation != 1 || (stride != 1 && stride != 2)
+        || channels != group || group != num_output || cached_blob.empty())
+    {
+        return ConvolutionDepthWise::forward_cached(bottom_blob, top_blob, mrect, cached_blob);
+    }
+
+    log_time_begin();
+
+    Mat bottom_blob_bordered;
+    bool* cached_map;
+    int ret = prepare_cached(bottom_blob, bottom_blob_bordered, top_blob, mrect, cached_blob, cached_map);
+    if (ret == 1)
+        return 0;
+    if (ret == 2)
+        return ConvolutionDepthWise::forward(bottom_blob, top_blob);
+    if (ret != 0)
+        return ret;
+
+    if (stride == 1)
+        convdw3x3s1_sse_cached(bottom_blob_bordered, top_blob, weight_data, bias_data, cached_map);
+    else
+        convdw3x3s2_sse_cached(bottom_blob_bordered, top_blob, weight_data, bias_data, cached_map);
+
+    activate(top_blob, cached_map);
+
+    free(cached_map);
+
+    log_time_end("convdepthwise_x86_cached");
+
+    return 0;
+}
+#endif // NCNN_CNNCACHE
+
+} // namespace ncnn
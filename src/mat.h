@@ -20,6 +20,30 @@
 
 namespace ncnn {
 
+// the dimensions of a blob without its data, dims 0 when unknown
+class MatShape
+{
+public:
+    MatShape() : dims(0), w(0), h(0), c(0) {}
+    MatShape(int _w) : dims(1), w(_w), h(1), c(1) {}
+    MatShape(int _w, int _h) : dims(2), w(_w), h(_h), c(1) {}
+    MatShape(int _w, int _h, int _c) : dims(3), w(_w), h(_h), c(_c) {}
+
+    bool empty() const { return dims == 0 || w * h * c == 0; }
+
+    bool operator==(const MatShape& rhs) const
+    {
+        return dims == rhs.dims && w == rhs.w && h == rhs.h && c == rhs.c;
+    }
+    bool operator!=(const MatShape& rhs) const { return !(*this == rhs); }
+
+public:
+    int dims;
+    int w;
+    int h;
+    int c;
+};
+
 // the three dimension matrix
 class Mat
 {
@@ -68,6 +92,8 @@ public:
     void release();
 
     bool empty() const;
+    // dimensions without the data
+    MatShape shape() const;
     size_t total() const;
 
     // data reference
@@ -107,6 +133,16 @@ public:
     // convenient construct from pixel data and resize to specific size
     static Mat from_pixels_resize(const unsigned char* pixels, int type, int w, int h, int target_width, int target_height);
 
+    // convenient construct from camera yuv420 frames in one pass, colour converted,
+    // bilinear resized and mean/normalized like substract_mean_normalize, pass 0 to skip
+    // type is PIXEL_RGB or PIXEL_BGR for the channel order of the result
+    // yuv420sp is NV21, the y plane followed by interleaved v/u as android cameras deliver
+    static Mat from_yuv420sp_resize(const unsigned char* yuv420sp, int w, int h, int type, int target_width, int target_height,
+                                    const float* mean_vals, const float* norm_vals);
+    // yuv420p is I420, the y plane followed by the u plane and the v plane
+    static Mat from_yuv420p_resize(const unsigned char* yuv420p, int w, int h, int type, int target_width, int target_height,
+                                   const float* mean_vals, const float* norm_vals);
+
     // convenient export to pixel data
     void to_pixels(unsigned char* pixels, int type);
     // convenient export to pixel data and resize to specific size
@@ -132,6 +168,10 @@ public:
     int c;
 
     size_t cstep;
+
+    // the data is a slot of an extractor memory plan, set by the planner
+    // only, create keeps such data when the shape matches
+    bool arena_view;
 };
 
 // misc function
@@ -216,30 +256,30 @@ static inline void NCNN_XADD(int* addr, int delta) { int tmp = *addr; *addr += d
 #endif
 
 inline Mat::Mat()
-    : dims(0), data(0), refcount(0), w(0), h(0), c(0), cstep(0)
+    : dims(0), data(0), refcount(0), w(0), h(0), c(0), cstep(0), arena_view(false)
 {
 }
 
 inline Mat::Mat(int _w)
-    : dims(0), data(0), refcount(0)
+    : dims(0), data(0), refcount(0), arena_view(false)
 {
     create(_w);
 }
 
 inline Mat::Mat(int _w, int _h)
-    : dims(0), data(0), refcount(0)
+    : dims(0), data(0), refcount(0), arena_view(false)
 {
     create(_w, _h);
 }
 
 inline Mat::Mat(int _w, int _h, int _c)
-    : dims(0), data(0), refcount(0)
+    : dims(0), data(0), refcount(0), arena_view(false)
 {
     create(_w, _h, _c);
 }
 
 inline Mat::Mat(const Mat& m)
-    : dims(m.dims), data(m.data), refcount(m.refcount)
+    : dims(m.dims), data(m.data), refcount(m.refcount), arena_view(m.arena_view)
 {
     if (refcount)
         NCNN_XADD(refcount, 1);
@@ -252,7 +292,7 @@ inline Mat::Mat(const Mat& m)
 }
 
 inline Mat::Mat(int _w, float* _data)
-    : dims(1), data(_data), refcount(0)
+    : dims(1), data(_data), refcount(0), arena_view(false)
 {
     w = _w;
     h = 1;
@@ -262,7 +302,7 @@ inline Mat::Mat(int _w, float* _data)
 }
 
 inline Mat::Mat(int _w, int _h, float* _data)
-    : dims(2), data(_data), refcount(0)
+    : dims(2), data(_data), refcount(0), arena_view(false)
 {
     w = _w;
     h = _h;
@@ -272,7 +312,7 @@ inline Mat::Mat(int _w, int _h, float* _data)
 }
 
 inline Mat::Mat(int _w, int _h, int _c, float* _data)
-    : dims(3), data(_data), refcount(0)
+    : dims(3), data(_data), refcount(0), arena_view(false)
 {
     w = _w;
     h = _h;
@@ -306,6 +346,8 @@ inline Mat& Mat::operator=(const Mat& m)
 
     cstep = m.cstep;
 
+    arena_view = m.arena_view;
+
     return *this;
 }
 
@@ -473,6 +515,10 @@ inline Mat Mat::reshape(int _w, int _h, int _c) const
 
 inline void Mat::create(int _w)
 {
+    // a memory plan slot of the same shape is filled in place
+    if (arena_view && dims == 1 && w == _w)
+        return;
+
     release();
 
     dims = 1;
@@ -494,6 +540,10 @@ inline void Mat::create(int _w)
 
 inline void Mat::create(int _w, int _h)
 {
+    // a memory plan slot of the same shape is filled in place
+    if (arena_view && dims == 2 && w == _w && h == _h)
+        return;
+
     release();
 
     dims = 2;
@@ -515,6 +565,10 @@ inline void Mat::create(int _w, int _h)
 
 inline void Mat::create(int _w, int _h, int _c)
 {
+    // a memory plan slot of the same shape is filled in place
+    if (arena_view && dims == 3 && w == _w && h == _h && c == _c)
+        return;
+
     release();
 
     dims = 3;
@@ -555,6 +609,8 @@ inline void Mat::release()
     cstep = 0;
 
     refcount = 0;
+
+    arena_view = false;
 }
 
 inline bool Mat::empty() const
@@ -562,6 +618,16 @@ inline bool Mat::empty() const
     return data == 0 || total() == 0;
 }
 
+inline MatShape Mat::shape() const
+{
+    MatShape s;
+    s.dims = dims;
+    s.w = w;
+    s.h = h;
+    s.c = c;
+    return s;
+}
+
 inline size_t Mat::total() const
 {
     return cstep * c;
@@ -15,9 +15,13 @@
 #include "mat.h"
 #include <limits.h>
 #include <algorithm>
+#include <vector>
 #if __ARM_NEON
 #include <arm_neon.h>
 #endif // __ARM_NEON
+#if __SSE2__
+#include <emmintrin.h>
+#endif // __SSE2__
 
 namespace ncnn {
 
@@ -2081,4 +2085,253 @@ void Mat::to_pixels_resize(unsigned char* pixels, int type, int target_width, in
     }
 }
 
+// bilinear source position of each destination sample, as resize_bilinear
+static void yuv420_resize_coeffs(int srcw, int w, int* ofs, float* alpha)
+{
+    const double scale = (double)srcw / w;
+    for (int dx = 0; dx < w; dx++)
+    {
+        float fx = (float)((dx + 0.5) * scale - 0.5);
+        int sx = (int)fx;
+        fx -= sx;
+
+        if (fx < 0.f || sx < 0)
+        {
+            sx = 0;
+            fx = 0.f;
+        }
+        if (sx >= srcw - 1)
+        {
+            sx = srcw - 2;
+            fx = 1.f;
+        }
+
+        ofs[dx] = sx;
+        alpha[dx] = fx;
+    }
+}
+
+// bt.601 video range as ConvertYUV420SPToARGB8888, channel q of the result
+// is cy[q] * max(y - 16, 0) + cu[q] * u + cv[q] * v + cbias[q] clamped to [0, 255]
+struct yuv420_coeffs
+{
+    float cy[3];
+    float cu[3];
+    float cv[3];
+    float cbias[3];
+};
+
+// horizontal pass of one luma row, both taps colour converted before blending
+// so saturated edges blend like the camera ARGB path, chroma is nearest
+// upsampled to luma resolution first the same way
+static void yuv420_hresize_row(const unsigned char* Y, const unsigned char* U, const unsigned char* V, int uv_step,
+                               int w, const int* xofs, const float* ialpha, const yuv420_coeffs& c,
+                               float* taps, float* row0, float* row1, float* row2)
+{
+    float* ty0 = taps;
+    float* ty1 = ty0 + w;
+    float* tu0 = ty1 + w;
+    float* tu1 = tu0 + w;
+    float* tv0 = tu1 + w;
+    float* tv1 = tv0 + w;
+    for (int dx = 0; dx < w; dx++)
+    {
+        const int sx = xofs[dx];
+        const int u0 = (sx >> 1) * uv_step;
+        const int u1 = ((sx + 1) >> 1) * uv_step;
+
+        ty0[dx] = Y[sx];
+        ty1[dx] = Y[sx + 1];
+        tu0[dx] = U[u0];
+        tu1[dx] = U[u1];
+        tv0[dx] = V[u0];
+        tv1[dx] = V[u1];
+    }
+
+    float* rows[3] = {row0, row1, row2};
+
+    int dx = 0;
+#if __ARM_NEON
+    float32x4_t _16 = vdupq_n_f32(16.f);
+    float32x4_t _zero = vdupq_n_f32(0.f);
+    float32x4_t _255 = vdupq_n_f32(255.f);
+    for (; dx + 3 < w; dx += 4)
+    {
+        float32x4_t _y0 = vmaxq_f32(vsubq_f32(vld1q_f32(ty0 + dx), _16), _zero);
+        float32x4_t _y1 = vmaxq_f32(vsubq_f32(vld1q_f32(ty1 + dx), _16), _zero);
+        float32x4_t _u0 = vld1q_f32(tu0 + dx);
+        float32x4_t _u1 = vld1q_f32(tu1 + dx);
+        float32x4_t _v0 = vld1q_f32(tv0 + dx);
+        float32x4_t _v1 = vld1q_f32(tv1 + dx);
+        float32x4_t _a = vld1q_f32(ialpha + dx);
+
+        for (int q = 0; q < 3; q++)
+        {
+            float32x4_t _bias = vdupq_n_f32(c.cbias[q]);
+            float32x4_t _p0 = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(_bias, _y0, c.cy[q]), _u0, c.cu[q]), _v0, c.cv[q]);
+            float32x4_t _p1 = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(_bias, _y1, c.cy[q]), _u1, c.cu[q]), _v1, c.cv[q]);
+            _p0 = vminq_f32(vmaxq_f32(_p0, _zero), _255);
+            _p1 = vminq_f32(vmaxq_f32(_p1, _zero), _255);
+            vst1q_f32(rows[q] + dx, vmlaq_f32(_p0, vsubq_f32(_p1, _p0), _a));
+        }
+    }
+#elif __SSE2__
+    __m128 _16 = _mm_set1_ps(16.f);
+    __m128 _zero = _mm_setzero_ps();
+    __m128 _255 = _mm_set1_ps(255.f);
+    for (; dx + 3 < w; dx += 4)
+    {
+        __m128 _y0 = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(ty0 + dx), _16), _zero);
+        __m128 _y1 = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(ty1 + dx), _16), _zero);
+        __m128 _u0 = _mm_loadu_ps(tu0 + dx);
+        __m128 _u1 = _mm_loadu_ps(tu1 + dx);
+        __m128 _v0 = _mm_loadu_ps(tv0 + dx);
+        __m128 _v1 = _mm_loadu_ps(tv1 + dx);
+        __m128 _a = _mm_loadu_ps(ialpha + dx);
+
+        for (int q = 0; q < 3; q++)
+        {
+            __m128 _bias = _mm_set1_ps(c.cbias[q]);
+            __m128 _cy = _mm_set1_ps(c.cy[q]);
+            __m128 _cu = _mm_set1_ps(c.cu[q]);
+            __m128 _cv = _mm_set1_ps(c.cv[q]);
+            __m128 _p0 = _mm_add_ps(_mm_add_ps(_bias, _mm_mul_ps(_y0, _cy)), _mm_add_ps(_mm_mul_ps(_u0, _cu), _mm_mul_ps(_v0, _cv)));
+            __m128 _p1 = _mm_add_ps(_mm_add_ps(_bias, _mm_mul_ps(_y1, _cy)), _mm_add_ps(_mm_mul_ps(_u1, _cu), _mm_mul_ps(_v1, _cv)));
+            _p0 = _mm_min_ps(_mm_max_ps(_p0, _zero), _255);
+            _p1 = _mm_min_ps(_mm_max_ps(_p1, _zero), _255);
+            _mm_storeu_ps(rows[q] + dx, _mm_add_ps(_p0, _mm_mul_ps(_mm_sub_ps(_p1, _p0), _a)));
+        }
+    }
+#endif
+    for (; dx < w; dx++)
+    {
+        const float y0 = std::max(ty0[dx] - 16.f, 0.f);
+        const float y1 = std::max(ty1[dx] - 16.f, 0.f);
+        for (int q = 0; q < 3; q++)
+        {
+            float p0 = c.cbias[q] + c.cy[q] * y0 + c.cu[q] * tu0[dx] + c.cv[q] * tv0[dx];
+            float p1 = c.cbias[q] + c.cy[q] * y1 + c.cu[q] * tu1[dx] + c.cv[q] * tv1[dx];
+            p0 = std::min(std::max(p0, 0.f), 255.f);
+            p1 = std::min(std::max(p1, 0.f), 255.f);
+            rows[q][dx] = p0 + (p1 - p0) * ialpha[dx];
+        }
+    }
+}
+
+static Mat from_yuv420_resize(const unsigned char* y_plane, const unsigned char* u_plane, const unsigned char* v_plane,
+                              int uv_step, int uv_stride, int w, int h, int type, int target_width, int target_height,
+                              const float* mean_vals, const float* norm_vals)
+{
+    if (type != Mat::PIXEL_RGB && type != Mat::PIXEL_BGR)
+        return Mat();
+
+    if (w < 2 || h < 2 || target_width < 1 || target_height < 1)
+        return Mat();
+
+    Mat m(target_width, target_height, 3);
+    if (m.empty())
+        return m;
+
+    const int tw = target_width;
+    std::vector<int> xofs(tw);
+    std::vector<float> ialpha(tw);
+    std::vector<int> yofs(target_height);
+    std::vector<float> ibeta(target_height);
+    yuv420_resize_coeffs(w, tw, &xofs[0], &ialpha[0]);
+    yuv420_resize_coeffs(h, target_height, &yofs[0], &ibeta[0]);
+
+    const int r = type == Mat::PIXEL_RGB ? 0 : 2;
+    const int b = 2 - r;
+    yuv420_coeffs c;
+    c.cu[r] = 0.f;
+    c.cv[r] = 1.596f;
+    c.cu[1] = -0.391f;
+    c.cv[1] = -0.813f;
+    c.cu[b] = 2.018f;
+    c.cv[b] = 0.f;
+    for (int q = 0; q < 3; q++)
+    {
+        c.cy[q] = 1.164f;
+        c.cbias[q] = -128.f * (c.cu[q] + c.cv[q]);
+    }
+
+    #pragma omp parallel for
+    for (int dy = 0; dy < target_height; dy++)
+    {
+        const int sy = yofs[dy];
+        const float b1 = ibeta[dy];
+        const float b0 = 1.f - b1;
+
+        std::vector<float> buf(tw * 12);
+        float* taps = &buf[0];
+        float* rows0 = taps + tw * 6;
+        float* rows1 = rows0 + tw * 3;
+
+        yuv420_hresize_row(y_plane + sy * w, u_plane + (sy >> 1) * uv_stride, v_plane + (sy >> 1) * uv_stride,
+                           uv_step, tw, &xofs[0], &ialpha[0], c, taps, rows0, rows0 + tw, rows0 + tw * 2);
+        yuv420_hresize_row(y_plane + (sy + 1) * w, u_plane + ((sy + 1) >> 1) * uv_stride, v_plane + ((sy + 1) >> 1) * uv_stride,
+                           uv_step, tw, &xofs[0], &ialpha[0], c, taps, rows1, rows1 + tw, rows1 + tw * 2);
+
+        // vertical pass with mean and norm
+        for (int q = 0; q < 3; q++)
+        {
+            const float* row0 = rows0 + tw * q;
+            const float* row1 = rows1 + tw * q;
+            float* outptr = m.channel(q).row(dy);
+
+            const float mean = mean_vals ? mean_vals[q] : 0.f;
+            const float norm = norm_vals ? norm_vals[q] : 1.f;
+            // (row0 * b0 + row1 * b1 - mean) * norm
+            const float s0 = b0 * norm;
+            const float s1 = b1 * norm;
+            const float bias = -mean * norm;
+
+            int dx = 0;
+#if __ARM_NEON
+            float32x4_t _bias = vdupq_n_f32(bias);
+            for (; dx + 3 < tw; dx += 4)
+            {
+                float32x4_t _p = vmlaq_n_f32(_bias, vld1q_f32(row0 + dx), s0);
+                _p = vmlaq_n_f32(_p, vld1q_f32(row1 + dx), s1);
+                vst1q_f32(outptr + dx, _p);
+            }
+#elif __SSE2__
+            __m128 _bias = _mm_set1_ps(bias);
+            __m128 _s0 = _mm_set1_ps(s0);
+            __m128 _s1 = _mm_set1_ps(s1);
+            for (; dx + 3 < tw; dx += 4)
+            {
+                __m128 _p = _mm_add_ps(_bias, _mm_mul_ps(_mm_loadu_ps(row0 + dx), _s0));
+                _p = _mm_add_ps(_p, _mm_mul_ps(_mm_loadu_ps(row1 + dx), _s1));
+                _mm_storeu_ps(outptr + dx, _p);
+            }
+#endif
+            for (; dx < tw; dx++)
+            {
+                outptr[dx] = bias + row0[dx] * s0 + row1[dx] * s1;
+            }
+        }
+    }
+
+    return m;
+}
+
+Mat Mat::from_yuv420sp_resize(const unsigned char* yuv420sp, int w, int h, int type, int target_width, int target_height,
+                              const float* mean_vals, const float* norm_vals)
+{
+    const int uvw = (w + 1) / 2;
+    const unsigned char* vu = yuv420sp + w * h;
+    return from_yuv420_resize(yuv420sp, vu + 1, vu, 2, uvw * 2, w, h, type, target_width, target_height, mean_vals, norm_vals);
+}
+
+Mat Mat::from_yuv420p_resize(const unsigned char* yuv420p, int w, int h, int type, int target_width, int target_height,
+                             const float* mean_vals, const float* norm_vals)
+{
+    const int uvw = (w + 1) / 2;
+    const int uvh = (h + 1) / 2;
+    const unsigned char* u = yuv420p + w * h;
+    const unsigned char* v = u + uvw * uvh;
+    return from_yuv420_resize(yuv420p, u, v, 1, uvw, w, h, type, target_width, target_height, mean_vals, norm_vals);
+}
+
 } // namespace ncnn
@@ -3,33 +3,16 @@
 
 #if NCNN_CNNCACHE
 
-namespace ncnn {
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "mat.h"
 
-#if NCNN_CNNCACHE
-#include <android/log.h>
-#endif
-
-#define  LOG_TAG    "NCNN_CNNCache"
-#define  LOGE(...)  __android_log_print(ANDROID_LOG_ERROR,LOG_TAG,__VA_ARGS__)
-#define  LOGW(...)  __android_log_print(ANDROID_LOG_WARN,LOG_TAG,__VA_ARGS__)
-#define  LOGD(...)  __android_log_print(ANDROID_LOG_DEBUG,LOG_TAG,__VA_ARGS__)
-#define  LOGI(...)  __android_log_print(ANDROID_LOG_INFO,LOG_TAG,__VA_ARGS__)
-
-struct timeval tv_begin, tv_end;
-inline void log_time_begin() {
-    gettimeofday(&tv_begin, NULL);
-}
-inline void log_time_end(char* str) {
-    static int LOG_TIME_CNT = 0;
-    if (strcmp("__reset", str) == 0) { // This is ugly, better to use extern
-        LOG_TIME_CNT = 0;
-        return;
-    }
-    gettimeofday(&tv_end, NULL);
-    int elapsed = ((tv_end.tv_sec - tv_begin.tv_sec) * 1000000.0f + tv_end.tv_usec - tv_begin.tv_usec) / 1000.0f;
-    LOGI("[%d-%s]\telapsed: %dms", LOG_TIME_CNT, str, elapsed);
-    LOG_TIME_CNT ++;
-}
+namespace ncnn {
 
 inline bool skip_reuse(bool* cached_map, int outw, int outh) {
     int changed_pixel = 0;
@@ -46,38 +29,118 @@ struct rect{
     int y1;
     int x2;
     int y2;
-    rect(int arg0, int arg1,int arg2, int arg3) {
+    // match quality of a reused block, PSNR in dB
+    float psnr;
+    rect(int arg0, int arg1,int arg2, int arg3, float arg4 = 0.f) {
         x1 = arg0;
         y1 = arg1;
         x2 = arg2;
         y2 = arg3;
+        psnr = arg4;
     }
     rect() {}
 };
 
+// a rect edge far outside any feature map, marks the whole map as changed
+#define MRECT_FULL (1 << 20)
+
 class MRect
 {
 
 public:
 
-    MRect() {}
+    MRect() : x_offset(0), y_offset(0), affine(false), affine_m(), warp_layers(0) {}
 
     void set_offset(int x, int y) {
         x_offset = x;
         y_offset = y;
     }
 
+    // experimental global motion model, maps a position in the current frame
+    // to the cached frame as x' = a * x + b * y + tx, y' = c * x + d * y + ty
+    // cached feature maps are then bilinear resampled instead of copied, and
+    // only the first max_warp_layers cached layers reuse, deeper ones recompute
+    void set_affine(float a, float b, float tx, float c, float d, float ty, int max_warp_layers) {
+        affine = true;
+        affine_m[0] = a;
+        affine_m[1] = b;
+        affine_m[2] = tx;
+        affine_m[3] = c;
+        affine_m[4] = d;
+        affine_m[5] = ty;
+        warp_layers = max_warp_layers;
+        x_offset = 0;
+        y_offset = 0;
+    }
+
+    // similarity transform, zoom around (cx, cy) and rotate by angle in radians
+    void set_similarity(float scale, float angle, float cx, float cy, float tx, float ty, int max_warp_layers) {
+        float a = scale * cos(angle);
+        float b = -scale * sin(angle);
+        set_affine(a, b, cx - a * cx - b * cy + tx, -b, a, cy + b * cx - a * cy + ty, max_warp_layers);
+    }
+
     void add_rect(int arg0, int arg1, int arg2, int arg3) {
         changed_vecs.push_back(rect(arg0, arg1, arg2, arg3));
     }
 
+    // reused block and how well it matched, as reported by the block matcher
+    void add_matched_rect(int arg0, int arg1, int arg2, int arg3, float psnr) {
+        matched_vecs.push_back(rect(arg0, arg1, arg2, arg3, psnr));
+    }
+
+    // copy with every matched block below min_psnr promoted to changed
+    void filter_by_quality(float min_psnr, MRect& out) const {
+        out.copyFrom(*this);
+        for (const struct rect& r: matched_vecs) {
+            if (r.psnr < min_psnr)
+                out.changed_vecs.push_back(r);
+        }
+    }
+
+    // copy with the changed rects shrunk to the tiles whose content differs
+    // from cached_blob at the offset location by at least eps
+    void shrink_by_feature(const Mat& blob, const Mat& cached_blob, float eps, MRect& out) const {
+        out.copyFrom(*this);
+        out.changed_vecs.clear();
+
+        const int tile = 8;
+        const int w = blob.w;
+        const int h = blob.h;
+        for (const struct rect& r: changed_vecs) {
+            const int x1 = std::max(r.x1, 0);
+            const int y1 = std::max(r.y1, 0);
+            const int x2 = std::min(r.x2, w - 1);
+            const int y2 = std::min(r.y2, h - 1);
+            for (int ty = y1; ty <= y2; ty += tile) {
+                const int ty2 = std::min(ty + tile - 1, y2);
+                // merge dirty tiles of a tile row into one rect
+                int run = -1;
+                for (int tx = x1; tx <= x2; tx += tile) {
+                    const int tx2 = std::min(tx + tile - 1, x2);
+                    bool dirty = tile_differs(blob, cached_blob, eps, tx, ty, tx2, ty2);
+                    if (dirty && run < 0)
+                        run = tx;
+                    if (!dirty && run >= 0) {
+                        out.add_rect(run, ty, tx - 1, ty2);
+                        run = -1;
+                    }
+                }
+                if (run >= 0)
+                    out.add_rect(run, ty, x2, ty2);
+            }
+        }
+    }
+
     void copyFrom(MRect other) {
         x_offset = other.x_offset;
         y_offset = other.y_offset;
+        copy_motion(other);
         changed_vecs.resize(0);
     	for (struct rect r: other.changed_vecs) {
             this->changed_vecs.push_back(r);
         }
+        matched_vecs = other.matched_vecs;
     }
 
     std::string info() {
@@ -93,10 +156,186 @@ public:
         return ret;
     }
 
+    void copy_motion(const MRect& other) {
+        affine = other.affine;
+        for (int i = 0; i < 6; i ++)
+            affine_m[i] = other.affine_m[i];
+        warp_layers = other.warp_layers;
+    }
+
     int size() {
         return changed_vecs.size();
     }
 
+    bool full_changed(int w, int h) const {
+        for (const struct rect& r: changed_vecs) {
+            if (r.x1 <= 0 && r.y1 <= 0 && r.x2 >= (w - 1) && r.y2 >= (h - 1))
+                return true;
+        }
+        return false;
+    }
+
+    // flag every changed pixel of a w x h map, true means recompute
+    void build_changed_map(bool* cached_map, int w, int h) const {
+        memset(cached_map, 0, w * h * sizeof(bool));
+        for (const struct rect& r: changed_vecs) {
+            for (int y = std::max(r.y1, 0); y <= std::min(r.y2, h - 1); y ++)
+                for (int x = std::max(r.x1, 0); x <= std::min(r.x2, w - 1); x ++)
+                    cached_map[y * w + x] = true;
+        }
+    }
+
+    // offset copy of the cached map into the reused part of top_blob
+    // rows and columns moving in from outside are left to the changed rects
+    void copy_cached(const Mat& cached_blob, Mat& top_blob) const {
+        const int w = top_blob.w;
+        const int h = top_blob.h;
+        const int cpy_w = w - abs(x_offset);
+        if (cpy_w <= 0)
+            return;
+
+        const int sh = (y_offset >= 0 ? 0 : -y_offset);
+        const int eh = (y_offset >= 0 ? (h - y_offset) : h);
+        const int sw = (x_offset >= 0 ? 0 : -x_offset);
+        const int channels = top_blob.c;
+        #pragma omp parallel for
+        for (int q = 0; q < channels; q ++) {
+            for (int y = sh; y < eh; y ++) {
+                float* dst = top_blob.channel(q).row(y) + sw;
+                const float* src = cached_blob.channel(q).row(y + y_offset) + sw + x_offset;
+                memcpy(dst, src, cpy_w * sizeof(float));
+            }
+        }
+    }
+
+    // offset copy of the cached output of an elementwise layer into top_blob,
+    // rects gets the clipped changed rects and the stripes moving in from
+    // outside, false when the whole map is cheaper to compute
+    bool reuse_elementwise(const Mat& bottom_blob, const Mat& cached_blob, Mat& top_blob, std::vector<struct rect>& rects) const {
+        const int w = bottom_blob.w;
+        const int h = bottom_blob.h;
+        if (affine || bottom_blob.dims != 3 || cached_blob.dims != 3
+            || cached_blob.w != w || cached_blob.h != h || cached_blob.c != bottom_blob.c)
+            return false;
+        if (abs(x_offset) >= w || abs(y_offset) >= h)
+            return false;
+
+        rects.clear();
+        for (const struct rect& r: changed_vecs) {
+            struct rect c(std::max(r.x1, 0), std::max(r.y1, 0), std::min(r.x2, w - 1), std::min(r.y2, h - 1));
+            if (c.x1 <= c.x2 && c.y1 <= c.y2)
+                rects.push_back(c);
+        }
+        if (x_offset > 0)
+            rects.push_back(rect(w - x_offset, 0, w - 1, h - 1));
+        if (x_offset < 0)
+            rects.push_back(rect(0, 0, -x_offset - 1, h - 1));
+        if (y_offset > 0)
+            rects.push_back(rect(0, h - y_offset, w - 1, h - 1));
+        if (y_offset < 0)
+            rects.push_back(rect(0, 0, w - 1, -y_offset - 1));
+
+        int area = 0;
+        for (const struct rect& r: rects)
+            area += (r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1);
+        if (area > w * h * 0.8)
+            return false;
+
+        top_blob.create(w, h, bottom_blob.c);
+        if (top_blob.empty())
+            return false;
+
+        copy_cached(cached_blob, top_blob);
+        return true;
+    }
+
+    // content moving in from outside the cached blob always differs
+    bool tile_differs(const Mat& blob, const Mat& cached_blob, float eps, int x1, int y1, int x2, int y2) const {
+        if (x1 + x_offset < 0 || x2 + x_offset >= cached_blob.w
+            || y1 + y_offset < 0 || y2 + y_offset >= cached_blob.h)
+            return true;
+
+        for (int q = 0; q < blob.c; q ++) {
+            const Mat m = blob.channel(q);
+            const Mat cm = cached_blob.channel(q);
+            for (int y = y1; y <= y2; y ++) {
+                const float* ptr = m.row(y);
+                const float* cptr = cm.row(y + y_offset) + x_offset;
+                for (int x = x1; x <= x2; x ++) {
+                    if (fabs(ptr[x] - cptr[x]) >= eps)
+                        return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // count a cached layer against the warp accuracy guard
+    // once the budget is used up everything deeper is recomputed
+    void guard_warp() {
+        if (!affine)
+            return;
+        if (warp_layers > 0) {
+            warp_layers --;
+            return;
+        }
+        affine = false;
+        changed_vecs.resize(0);
+        add_rect(0, 0, MRECT_FULL, MRECT_FULL);
+    }
+
+    // bilinear resample the cached feature map through the affine model
+    // pixels whose source falls outside the cached map are flagged for recompute
+    void warp_cached(const Mat& cached_blob, Mat& top_blob, bool* cached_map) const {
+        const int w = top_blob.w;
+        const int h = top_blob.h;
+        const int cw = cached_blob.w;
+        const int ch = cached_blob.h;
+
+        if (cw < 2 || ch < 2) {
+            memset(cached_map, 1, w * h * sizeof(bool));
+            return;
+        }
+
+        std::vector<int> ofs(w * h);
+        std::vector<float> alpha(w * h * 2);
+        for (int y = 0; y < h; y ++) {
+            for (int x = 0; x < w; x ++) {
+                int i = y * w + x;
+                if (cached_map[i])
+                    continue;
+                float sx = affine_m[0] * x + affine_m[1] * y + affine_m[2];
+                float sy = affine_m[3] * x + affine_m[4] * y + affine_m[5];
+                if (sx < 0.f || sy < 0.f || sx > cw - 1 || sy > ch - 1) {
+                    cached_map[i] = true;
+                    continue;
+                }
+                int x0 = std::min((int)sx, cw - 2);
+                int y0 = std::min((int)sy, ch - 2);
+                ofs[i] = y0 * cw + x0;
+                alpha[i * 2] = sx - x0;
+                alpha[i * 2 + 1] = sy - y0;
+            }
+        }
+
+        const int channels = top_blob.c;
+        #pragma omp parallel for
+        for (int q = 0; q < channels; q ++) {
+            const float* src = cached_blob.channel(q);
+            float* dst = top_blob.channel(q);
+            for (int i = 0; i < w * h; i ++) {
+                if (cached_map[i])
+                    continue;
+                const float* p = src + ofs[i];
+                float ax = alpha[i * 2];
+                float ay = alpha[i * 2 + 1];
+                float top = p[0] + (p[1] - p[0]) * ax;
+                float bottom = p[cw] + (p[cw + 1] - p[cw]) * ax;
+                dst[i] = top + (bottom - top) * ay;
+            }
+        }
+    }
+
     void forward_rect_conv_or_pool(
         struct rect& r1, struct rect& r2, int pad, int ksize, int stride) {
         
@@ -123,18 +362,76 @@ public:
         x_offset = bottom_mrect.x_offset / stride;
         y_offset = bottom_mrect.y_offset / stride;
 
+        // feature positions shrink with the stride, so does the translation
+        copy_motion(bottom_mrect);
+        affine_m[2] /= stride;
+        affine_m[5] /= stride;
+
         size_t size = bottom_mrect.size();
         changed_vecs.resize(size);
         for (size_t i = 0; i < size; i ++) {
             forward_rect_conv_or_pool(
                 changed_vecs[i], bottom_mrect.changed_vecs[i], pad, ksize, stride);
         }
+
+        // matched blocks grow like changed ones, they only matter once promoted
+        size = bottom_mrect.matched_vecs.size();
+        matched_vecs.resize(size);
+        for (size_t i = 0; i < size; i ++) {
+            forward_rect_conv_or_pool(
+                matched_vecs[i], bottom_mrect.matched_vecs[i], pad, ksize, stride);
+            matched_vecs[i].psnr = bottom_mrect.matched_vecs[i].psnr;
+        }
+        return 0;
+    }
+
+    // an input pixel of a transposed convolution reaches the output span
+    // [i * stride - pad, i * stride - pad + kernel_extent - 1]
+    void forward_rect_deconv(
+        struct rect& r1, const struct rect& r2, int pad, int kernel_extent, int stride) {
+        const int p = pad > 0 ? pad : 0;
+        r1.x1 = std::max(0, r2.x1 * stride - p);
+        r1.y1 = std::max(0, r2.y1 * stride - p);
+        r1.x2 = std::min(MRECT_FULL, r2.x2 * stride - p + kernel_extent - 1);
+        r1.y2 = std::min(MRECT_FULL, r2.y2 * stride - p + kernel_extent - 1);
+    }
+
+    int forward_in_deconv(MRect& bottom_mrect, int pad, int kernel_extent, int stride) {
+        // upsampling scales the translation up, it stays exact
+        x_offset = bottom_mrect.x_offset * stride;
+        y_offset = bottom_mrect.y_offset * stride;
+
+        copy_motion(bottom_mrect);
+        affine_m[2] *= stride;
+        affine_m[5] *= stride;
+
+        size_t size = bottom_mrect.size();
+        changed_vecs.resize(size);
+        for (size_t i = 0; i < size; i ++) {
+            forward_rect_deconv(
+                changed_vecs[i], bottom_mrect.changed_vecs[i], pad, kernel_extent, stride);
+        }
+
+        size = bottom_mrect.matched_vecs.size();
+        matched_vecs.resize(size);
+        for (size_t i = 0; i < size; i ++) {
+            forward_rect_deconv(
+                matched_vecs[i], bottom_mrect.matched_vecs[i], pad, kernel_extent, stride);
+            matched_vecs[i].psnr = bottom_mrect.matched_vecs[i].psnr;
+        }
         return 0;
     }
 
     int x_offset;
     int y_offset;
     std::vector<struct rect> changed_vecs;
+    // reused blocks with their match quality, see add_matched_rect
+    std::vector<struct rect> matched_vecs;
+
+    // affine motion model, see set_affine
+    bool affine;
+    float affine_m[6];
+    int warp_layers;
 };
 
 } // namespace ncnn
@@ -13,18 +13,185 @@
 // specific language governing permissions and limitations under the License.
 
 #include "net.h"
-// #include <android/log.h>
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include "benchmark.h"
+#include "threadpool.h"
+#include "layer/batchnorm.h"
+#include "layer/bias.h"
+#include "layer/convolution.h"
+#include "layer/prelu.h"
+#include "layer/relu.h"
+#include "layer/scale.h"
 
 #ifdef _OPENMP
 #include <omp.h>
 #endif // _OPENMP
 
+#if NCNN_CNNCACHE
+#include <deque>
+#endif // NCNN_CNNCACHE
+
 namespace ncnn {
 
-Net::Net()
+#if NCNN_CNNCACHE
+// copy blob into the cache, in place unless the cache is shared,
+// so extractors holding the previous snapshot keep seeing it unchanged
+static void snapshot_blob(Mat& cache_blob, const Mat& blob)
+{
+    if (cache_blob.refcount && *cache_blob.refcount == 1
+        && cache_blob.dims == blob.dims && cache_blob.w == blob.w
+        && cache_blob.h == blob.h && cache_blob.c == blob.c
+        && cache_blob.cstep == blob.cstep)
+    {
+        memcpy(cache_blob.data, blob.data, blob.total() * sizeof(float));
+        return;
+    }
+
+    cache_blob = blob.clone();
+}
+
+// single background worker snapshotting top blobs into the layer caches
+// jobs run in layer order, so early layers are ready for the next frame first
+class CacheCommitter
+{
+public:
+    CacheCommitter(int layer_count) : pending(layer_count, 0), pending_total(0), stop(false)
+    {
+        worker = std::thread(&CacheCommitter::run, this);
+    }
+
+    ~CacheCommitter()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        job_cond.notify_all();
+        worker.join();
+    }
+
+    void commit(int layer_index, const Mat& top_blob, Mat* cache_blob)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            Job job = { layer_index, top_blob, cache_blob };
+            jobs.push_back(job);
+            pending[layer_index] ++;
+            pending_total ++;
+        }
+        job_cond.notify_one();
+    }
+
+    void wait(int layer_index)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done_cond.wait(guard, [&]{ return pending[layer_index] == 0; });
+    }
+
+    void wait_all()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done_cond.wait(guard, [&]{ return pending_total == 0; });
+    }
+
+private:
+    struct Job
+    {
+        int layer_index;
+        // holds a reference so the blob outlives clear_blob_data
+        Mat top_blob;
+        Mat* cache_blob;
+    };
+
+    void run()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                job_cond.wait(guard, [&]{ return stop || !jobs.empty(); });
+                // pending jobs are drained before stopping
+                if (jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            snapshot_blob(*job.cache_blob, job.top_blob);
+            job.top_blob.release();
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                pending[job.layer_index] --;
+                pending_total --;
+            }
+            done_cond.notify_all();
+        }
+    }
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable job_cond;
+    std::condition_variable done_cond;
+    std::deque<Job> jobs;
+    std::vector<int> pending;
+    int pending_total;
+    bool stop;
+};
+
+CacheCommitHandle::CacheCommitHandle() : committer(0)
+{
+}
+
+CacheCommitHandle::CacheCommitHandle(const CacheCommitHandle& rhs) : committer(0)
+{
+    rhs.wait_all();
+}
+
+CacheCommitHandle& CacheCommitHandle::operator=(const CacheCommitHandle& rhs)
+{
+    if (this == &rhs)
+        return *this;
+
+    rhs.wait_all();
+
+    // our own commits target the cache about to be overwritten
+    delete committer;
+    committer = 0;
+
+    return *this;
+}
+
+CacheCommitHandle::~CacheCommitHandle()
+{
+    delete committer;
+}
+
+void CacheCommitHandle::wait(int layer_index) const
+{
+    if (committer)
+        committer->wait(layer_index);
+}
+
+void CacheCommitHandle::wait_all() const
+{
+    if (committer)
+        committer->wait_all();
+}
+#endif // NCNN_CNNCACHE
+
+Net::Net() : layer_fusion(false), async_depth(4), async_pending(0)
 {
 }
 
@@ -122,8 +289,11 @@ int Net::load_param(FILE* fp)
         {
             typeindex = custom_layer_to_index(layer_type);
             layer = create_custom_layer(typeindex);
+            typeindex |= LayerType::CustomBit;
         }
 
+        layer->typeindex = typeindex;
+
         layer->type = std::string(layer_type);
         layer->name = std::string(layer_name);
         // fprintf(stderr, "new layer %d %s\n", layer_index, layer_name);
@@ -194,6 +364,12 @@ int Net::load_param(FILE* fp)
         layer_index++;
     }
 
+    build_schedule();
+
+    // resolve the declared input sizes now, first lookups are then free
+    std::vector<MatShape> blob_shapes;
+    infer_shape(std::vector<int>(), std::vector<MatShape>(), blob_shapes);
+
     return 0;
 }
 
@@ -202,10 +378,7 @@ int Net::load_param(const char* protopath)
     FILE* fp = fopen(protopath, "rb");
     if (!fp)
     {
-#if NCNN_CNNCACHE
-        LOGE("Fail to load fopen param file: %s\n", protopath);
-#endif
-        fprintf(stderr, "fopen %s failed\n", protopath);
+        NCNN_LOGE("fopen %s failed", protopath);
         return -1;
     }
 
@@ -246,6 +419,8 @@ int Net::load_param_bin(FILE* fp)
             layer = create_custom_layer(custom_index);
         }
 
+        layer->typeindex = typeindex;
+
 //         layer->type = std::string(layer_type);
 //         layer->name = std::string(layer_name);
 //         fprintf(stderr, "new layer %d\n", typeindex);
@@ -290,6 +465,12 @@ int Net::load_param_bin(FILE* fp)
         layers[i] = layer;
     }
 
+    build_schedule();
+
+    // resolve the declared input sizes now, first lookups are then free
+    std::vector<MatShape> blob_shapes;
+    infer_shape(std::vector<int>(), std::vector<MatShape>(), blob_shapes);
+
     return 0;
 }
 
@@ -298,10 +479,7 @@ int Net::load_param_bin(const char* protopath)
     FILE* fp = fopen(protopath, "rb");
     if (!fp)
     {
-#if NCNN_CNNCACHE
-        LOGE("Fail to load fopen param_bin file: %s\n", protopath);
-#endif
-        fprintf(stderr, "fopen %s failed\n", protopath);
+        NCNN_LOGE("fopen %s failed", protopath);
         return -1;
     }
 
@@ -332,6 +510,9 @@ int Net::load_model(FILE* fp)
         }
     }
 
+    if (ret == 0 && layer_fusion)
+        fuse_layers();
+
     return ret;
 }
 
@@ -389,6 +570,8 @@ int Net::load_param(const unsigned char* _mem)
             layer = create_custom_layer(custom_index);
         }
 
+        layer->typeindex = typeindex;
+
 //         layer->type = std::string(layer_type);
 //         layer->name = std::string(layer_name);
 #if NCNN_CNNCACHE
@@ -435,6 +618,12 @@ int Net::load_param(const unsigned char* _mem)
         layers[i] = layer;
     }
 
+    build_schedule();
+
+    // resolve the declared input sizes now, first lookups are then free
+    std::vector<MatShape> blob_shapes;
+    infer_shape(std::vector<int>(), std::vector<MatShape>(), blob_shapes);
+
     return mem - _mem;
 }
 
@@ -460,17 +649,219 @@ int Net::load_model(const unsigned char* _mem)
         }
     }
 
+    if (layer_fusion)
+        fuse_layers();
+
     return mem - _mem;
 }
 
 void Net::clear()
 {
+    // running extract_async requests still use the layers
+    {
+        std::unique_lock<std::mutex> guard(async_lock);
+        async_cond.wait(guard, [&]{ return async_pending == 0; });
+    }
+
     blobs.clear();
     for (size_t i=0; i<layers.size(); i++)
     {
         delete layers[i];
     }
     layers.clear();
+    schedule.clear();
+    schedule_pos.clear();
+
+    std::lock_guard<std::mutex> lock(shape_cache_lock);
+    shape_cache.clear();
+}
+
+void Net::set_layer_fusion(bool enable)
+{
+    layer_fusion = enable;
+}
+
+// fold out = conv * scale + bias per output channel into the convolution
+// weights, either may be null, the weights may reference external memory
+// so the folded ones are copies
+static int fold_convolution(Convolution* conv, const float* scale, const float* bias)
+{
+    const int num_output = conv->num_output;
+    const int weight_size = conv->weight_data_size / num_output;
+
+    Mat weight_data = conv->weight_data.clone();
+    if (weight_data.empty())
+        return -100;
+
+    Mat bias_data;
+    if (conv->bias_term)
+    {
+        bias_data = conv->bias_data.clone();
+    }
+    else
+    {
+        bias_data.create(num_output);
+        bias_data.fill(0.f);
+    }
+    if (bias_data.empty())
+        return -100;
+
+    for (int p=0; p<num_output; p++)
+    {
+        if (scale)
+        {
+            float* kptr = (float*)weight_data + weight_size * p;
+            for (int k=0; k<weight_size; k++)
+            {
+                kptr[k] *= scale[p];
+            }
+
+            bias_data[p] *= scale[p];
+        }
+
+        if (bias)
+            bias_data[p] += bias[p];
+    }
+
+    conv->weight_data = weight_data;
+    conv->bias_data = bias_data;
+    conv->bias_term = 1;
+
+    return 0;
+}
+
+void Net::fuse_layers()
+{
+    const int layer_count = layers.size();
+    std::vector<char> fused(layer_count, 0);
+
+    for (int i=0; i<layer_count; i++)
+    {
+        Layer* layer = layers[i];
+        if (!layer || (layer->typeindex != LayerType::Convolution && layer->typeindex != LayerType::ConvolutionDepthWise))
+            continue;
+
+        Convolution* conv = (Convolution*)layer;
+        if (conv->tops.size() != 1 || conv->num_output <= 0 || conv->weight_data.empty()
+            || conv->weight_data_size % conv->num_output != 0)
+            continue;
+
+        // follow the chain while the conv output has a single reader
+        // taking it alone, the activation ends it
+        while (conv->activation_type == 0)
+        {
+            const Blob& top = blobs[conv->tops[0]];
+            if (top.consumers.size() != 1)
+                break;
+
+            const int next_index = top.consumers[0];
+            Layer* next = layers[next_index];
+            if (!next || next->bottoms.size() != 1 || next->tops.size() != 1)
+                break;
+
+            const int num_output = conv->num_output;
+
+            int ret = -1;
+            if (next->typeindex == LayerType::BatchNorm)
+            {
+                const BatchNorm* batchnorm = (const BatchNorm*)next;
+                if (batchnorm->channels == num_output)
+                    ret = fold_convolution(conv, batchnorm->b_data, batchnorm->a_data);
+            }
+            else if (next->typeindex == LayerType::Scale)
+            {
+                const Scale* scale = (const Scale*)next;
+                if (scale->scale_data_size == num_output)
+                    ret = fold_convolution(conv, scale->scale_data, scale->bias_term ? (const float*)scale->bias_data : 0);
+            }
+            else if (next->typeindex == LayerType::Bias)
+            {
+                const Bias* bias = (const Bias*)next;
+                if (bias->bias_data_size == num_output)
+                    ret = fold_convolution(conv, 0, bias->bias_data);
+            }
+            else if (next->typeindex == LayerType::ReLU)
+            {
+                Mat slope(1);
+                if (!slope.empty())
+                {
+                    slope[0] = ((const ReLU*)next)->slope;
+                    conv->activation_params = slope;
+                    conv->activation_type = 1;
+                    ret = 0;
+                }
+            }
+            else if (next->typeindex == LayerType::PReLU)
+            {
+                const PReLU* prelu = (const PReLU*)next;
+                if (prelu->num_slope == 1 || prelu->num_slope == num_output)
+                {
+                    Mat slope = prelu->slope_data.clone();
+                    if (!slope.empty())
+                    {
+                        conv->activation_params = slope;
+                        conv->activation_type = 1;
+                        ret = 0;
+                    }
+                }
+            }
+
+            if (ret != 0)
+                break;
+
+            // the conv now produces the output of the layer folded into it
+            const int folded_blob_index = conv->tops[0];
+            blobs[folded_blob_index].producer = -1;
+            blobs[folded_blob_index].consumers.clear();
+            blobs[next->tops[0]].producer = i;
+            conv->tops[0] = next->tops[0];
+
+            fused[next_index] = 1;
+        }
+    }
+
+    // drop the fused layers and renumber the rest
+    std::vector<int> layer_indices(layer_count, -1);
+    int count = 0;
+    for (int i=0; i<layer_count; i++)
+    {
+        if (fused[i])
+        {
+            delete layers[i];
+            continue;
+        }
+
+        layer_indices[i] = count;
+        layers[count++] = layers[i];
+    }
+
+    if (count == layer_count)
+        return;
+
+    layers.resize(count);
+
+    for (size_t i=0; i<blobs.size(); i++)
+    {
+        Blob& blob = blobs[i];
+        if (blob.producer != -1)
+            blob.producer = layer_indices[blob.producer];
+
+        for (size_t j=0; j<blob.consumers.size(); j++)
+        {
+            blob.consumers[j] = layer_indices[blob.consumers[j]];
+        }
+    }
+
+    build_schedule();
+
+    // shapes were resolved over the old schedule at load_param
+    {
+        std::lock_guard<std::mutex> lock(shape_cache_lock);
+        shape_cache.clear();
+    }
+
+    std::vector<MatShape> blob_shapes;
+    infer_shape(std::vector<int>(), std::vector<MatShape>(), blob_shapes);
 }
 
 Extractor Net::create_extractor() const
@@ -478,6 +869,45 @@ Extractor Net::create_extractor() const
     return Extractor(this, blobs.size());
 }
 
+void Net::set_async_depth(int depth)
+{
+    std::lock_guard<std::mutex> guard(async_lock);
+    async_depth = std::max(1, depth);
+    async_cond.notify_all();
+}
+
+void Net::begin_async(ThreadPool* pool) const
+{
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> guard(async_lock);
+            if (async_pending < async_depth)
+            {
+                async_pending++;
+                return;
+            }
+        }
+
+        // the requests holding the slots may be queued behind this thread
+        if (!pool->run_one())
+        {
+            std::unique_lock<std::mutex> guard(async_lock);
+            async_cond.wait(guard, [&]{ return async_pending < async_depth; });
+            async_pending++;
+            return;
+        }
+    }
+}
+
+void Net::end_async() const
+{
+    // notify under the lock, clear may destroy the net once it sees zero
+    std::lock_guard<std::mutex> guard(async_lock);
+    async_pending--;
+    async_cond.notify_all();
+}
+
 #if NCNN_STRING
 int Net::find_blob_index_by_name(const char* name) const
 {
@@ -539,86 +969,983 @@ Layer* Net::create_custom_layer(int index)
     return layer_creator();
 }
 
-int Net::forward_layer(int layer_index, Extractor* extractor) const
+int Net::build_schedule()
 {
-    bool lightmode = extractor->lightmode;
-    std::vector<Mat>& blob_mats = extractor->blob_mats;
-    const Layer* layer = layers[layer_index];
-    int ret;
-
-// #if NCNN_CNNCACHE
-//     LOGI("Net::forward_layer index: %d name: %s type: %s\n",
-//         layer_index, layer->name.c_str(), layer->type.c_str());
-// #endif
-    // fprintf(stderr, "forward_layer %d %s\n", layer_index, layer->name.c_str());
-
-    if (layer->one_blob_only)
+    // topological order of the layers, ties broken by layer index so a
+    // param file already in order keeps its order
+    const int layer_count = layers.size();
+    std::vector<int> indegree(layer_count, 0);
+    for (int i=0; i<layer_count; i++)
     {
-        // load bottom blob
-        int bottom_blob_index = layer->bottoms[0];
-        int top_blob_index = layer->tops[0];
+        if (!layers[i])
+            continue;
 
-        if (blob_mats[bottom_blob_index].dims == 0)
+        for (size_t j=0; j<layers[i]->bottoms.size(); j++)
         {
-            ret = forward_layer(blobs[bottom_blob_index].producer, extractor);
-            if (ret != 0)
-                return ret;
+            if (blobs[layers[i]->bottoms[j]].producer != -1)
+                indegree[i]++;
         }
+    }
 
-        // LOGI("Net::forward_layer index: %d name: %s type: %s\n",
-        //     layer_index, layer->name.c_str(), layer->type.c_str());
+    std::priority_queue<int, std::vector<int>, std::greater<int> > ready;
+    for (int i=0; i<layer_count; i++)
+    {
+        if (layers[i] && indegree[i] == 0)
+            ready.push(i);
+    }
 
-        Mat bottom_blob = blob_mats[bottom_blob_index];
+    schedule.clear();
+    schedule_pos.assign(layer_count, -1);
+    while (!ready.empty())
+    {
+        int layer_index = ready.top();
+        ready.pop();
 
-        if (lightmode)
+        schedule_pos[layer_index] = schedule.size();
+        schedule.push_back(layer_index);
+
+        const Layer* layer = layers[layer_index];
+        for (size_t i=0; i<layer->tops.size(); i++)
         {
-            // delete after taken in light mode
-            blob_mats[bottom_blob_index].release();
-            // deep copy for inplace forward if data is shared
-            if (layer->support_inplace && *bottom_blob.refcount != 1)
+            const Blob& blob = blobs[layer->tops[i]];
+            for (size_t j=0; j<blob.consumers.size(); j++)
             {
-                bottom_blob = bottom_blob.clone();
+                int consumer = blob.consumers[j];
+                if (layers[consumer] && --indegree[consumer] == 0)
+                    ready.push(consumer);
             }
         }
+    }
 
-#if NCNN_CNNCACHE
-        ret = layer->forward_mrect(
-            extractor->matched_rects[bottom_blob_index],
-            extractor->matched_rects[top_blob_index]);
-        if (ret != 0)
-            LOGE("Failing forward_mrect: %d", ret);
-#endif
+    if ((int)schedule.size() != layer_count)
+    {
+        fprintf(stderr, "network graph has a cycle or a broken layer, %d of %d layers scheduled\n", (int)schedule.size(), layer_count);
+        return -1;
+    }
 
-        // forward
-        if (lightmode && layer->support_inplace)
-        {
-            Mat& bottom_top_blob = bottom_blob;
-            ret = layer->forward_inplace(bottom_top_blob);
-            if (ret != 0)
-                return ret;
+    return 0;
+}
 
-            // store top blob
-            blob_mats[top_blob_index] = bottom_top_blob;
-        }
-        else
+int Net::infer_shape(const std::vector<int>& input_blob_indices, const std::vector<MatShape>& input_shapes,
+                     std::vector<MatShape>& blob_shapes) const
+{
+    if (input_blob_indices.size() != input_shapes.size())
+        return -1;
+
+    for (size_t i=0; i<input_blob_indices.size(); i++)
+    {
+        if (input_blob_indices[i] < 0 || input_blob_indices[i] >= (int)blobs.size())
+            return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(shape_cache_lock);
+        for (size_t i=0; i<shape_cache.size(); i++)
         {
-            Mat top_blob;
-#if NCNN_CNNCACHE
-            // TODO: we should add this every place forward func is called but
-            // conv is one_blob_only and has no light impl it's enough we impl here
-            if (extractor->cache_mode) {
-                ret = layer->forward_cached(bottom_blob, top_blob,
-                    extractor->matched_rects[top_blob_index],
-                    extractor->blob_mats_cached[layer_index]);
-            }
-            else {
-                ret = layer->forward(bottom_blob, top_blob);
+            const ShapeCacheEntry& entry = shape_cache[i];
+            if (entry.input_blob_indices == input_blob_indices && entry.input_shapes == input_shapes)
+            {
+                blob_shapes = entry.blob_shapes;
+                return entry.ret;
             }
-#else
-            ret = layer->forward(bottom_blob, top_blob);
-#endif
-            if (ret != 0)
-                return ret;
+        }
+    }
+
+    int ret = resolve_shapes(input_blob_indices, input_shapes, blob_shapes);
+
+    // a handful of input sizes covers the usual multi-scale use
+    const size_t shape_cache_capacity = 16;
+
+    std::lock_guard<std::mutex> lock(shape_cache_lock);
+    if (shape_cache.size() >= shape_cache_capacity)
+        shape_cache.erase(shape_cache.begin());
+
+    ShapeCacheEntry entry;
+    entry.input_blob_indices = input_blob_indices;
+    entry.input_shapes = input_shapes;
+    entry.blob_shapes = blob_shapes;
+    entry.ret = ret;
+    shape_cache.push_back(entry);
+
+    return ret;
+}
+
+int Net::infer_shape(int input_blob_index, const MatShape& input_shape, std::vector<MatShape>& blob_shapes) const
+{
+    return infer_shape(std::vector<int>(1, input_blob_index), std::vector<MatShape>(1, input_shape), blob_shapes);
+}
+
+#if NCNN_STRING
+int Net::infer_shape(const std::vector<const char*>& input_blob_names, const std::vector<MatShape>& input_shapes,
+                     std::vector<MatShape>& blob_shapes) const
+{
+    std::vector<int> input_blob_indices(input_blob_names.size());
+    for (size_t i=0; i<input_blob_names.size(); i++)
+    {
+        input_blob_indices[i] = find_blob_index_by_name(input_blob_names[i]);
+        if (input_blob_indices[i] == -1)
+            return -1;
+    }
+
+    return infer_shape(input_blob_indices, input_shapes, blob_shapes);
+}
+
+int Net::infer_shape(const char* input_blob_name, const MatShape& input_shape, std::vector<MatShape>& blob_shapes) const
+{
+    int input_blob_index = find_blob_index_by_name(input_blob_name);
+    if (input_blob_index == -1)
+        return -1;
+
+    return infer_shape(input_blob_index, input_shape, blob_shapes);
+}
+#endif // NCNN_STRING
+
+int Net::resolve_shapes(const std::vector<int>& input_blob_indices, const std::vector<MatShape>& input_shapes,
+                        std::vector<MatShape>& blob_shapes) const
+{
+    blob_shapes.assign(blobs.size(), MatShape());
+    for (size_t i=0; i<input_blob_indices.size(); i++)
+    {
+        blob_shapes[input_blob_indices[i]] = input_shapes[i];
+    }
+
+    int ret = 0;
+    std::vector<MatShape> bottom_shapes;
+    std::vector<MatShape> top_shapes;
+    for (size_t s=0; s<schedule.size(); s++)
+    {
+        const Layer* layer = layers[schedule[s]];
+
+        // a given blob wins over what its producer would make of it
+        bool resolved = true;
+        for (size_t i=0; i<layer->tops.size(); i++)
+        {
+            if (blob_shapes[layer->tops[i]].empty())
+                resolved = false;
+        }
+        if (resolved)
+            continue;
+
+        bool ready = true;
+        bottom_shapes.resize(layer->bottoms.size());
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+        {
+            bottom_shapes[i] = blob_shapes[layer->bottoms[i]];
+            if (bottom_shapes[i].empty())
+                ready = false;
+        }
+        if (!ready)
+        {
+            ret = -1;
+            continue;
+        }
+
+        if (layer->one_blob_only)
+        {
+            MatShape top_shape;
+            if (layer->infer_shape(bottom_shapes.empty() ? MatShape() : bottom_shapes[0], top_shape) != 0 || top_shape.empty())
+            {
+                ret = -1;
+                continue;
+            }
+
+            blob_shapes[layer->tops[0]] = top_shape;
+        }
+        else
+        {
+            top_shapes.assign(layer->tops.size(), MatShape());
+            if (layer->infer_shape(bottom_shapes, top_shapes) != 0)
+            {
+                ret = -1;
+                continue;
+            }
+
+            for (size_t i=0; i<layer->tops.size(); i++)
+            {
+                if (top_shapes[i].empty())
+                    ret = -1;
+
+                blob_shapes[layer->tops[i]] = top_shapes[i];
+            }
+        }
+    }
+
+    return ret;
+}
+
+int Net::forward_blobs(const int* blob_indices, int count, Extractor* extractor) const
+{
+    std::vector<Mat>& blob_mats = extractor->blob_mats;
+    std::vector<int>& blob_refs = extractor->blob_refs;
+    std::vector<char>& layer_pending = extractor->layer_pending;
+
+    // mark the missing outputs, a reference of their own keeps them alive
+    // in light mode when another requested blob consumes them
+    int last = -1;
+    for (int i=0; i<count; i++)
+    {
+        int blob_index = blob_indices[i];
+        if (blob_mats[blob_index].dims != 0)
+            continue;
+
+        int layer_index = blobs[blob_index].producer;
+        if (layer_index == -1 || schedule_pos[layer_index] == -1)
+            return -1;
+
+        blob_refs[blob_index]++;
+        last = std::max(last, schedule_pos[layer_index]);
+    }
+
+    // walk the schedule backwards, a layer runs when one of its tops is
+    // wanted and missing, and then wants its own missing bottoms
+    for (int p=last; p>=0; p--)
+    {
+        const Layer* layer = layers[schedule[p]];
+
+        bool pending = false;
+        for (size_t i=0; i<layer->tops.size(); i++)
+        {
+            int top_blob_index = layer->tops[i];
+            if (blob_refs[top_blob_index] != 0 && blob_mats[top_blob_index].dims == 0)
+                pending = true;
+        }
+
+        layer_pending[p] = pending;
+        if (!pending)
+            continue;
+
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+        {
+            blob_refs[layer->bottoms[i]]++;
+        }
+    }
+
+    // follow the memory plan if it was made for exactly these layers
+    const MemoryPlan& plan = extractor->memory_plan;
+    bool planned = !plan.views.empty() && (int)plan.pending.size() == last + 1
+        && plan.lightmode == extractor->lightmode
+#if NCNN_CNNCACHE
+        && plan.cache_mode == extractor->cache_mode
+#endif
+        && std::equal(plan.pending.begin(), plan.pending.end(), layer_pending.begin());
+    extractor->memory_planned = planned;
+
+    int ret = 0;
+    if (extractor->branch_parallel && !planned)
+    {
+        ret = forward_dataflow(last, extractor);
+    }
+    else
+    {
+        const float** ranges = extractor->usage_ranges.empty() ? 0 : &extractor->usage_ranges[0];
+        for (int p=0; p<=last; p++)
+        {
+            if (!layer_pending[p])
+                continue;
+
+            ret = forward_scheduled(schedule[p], extractor, ranges, false);
+            if (ret != 0)
+                break;
+        }
+    }
+
+    if (planned)
+    {
+        // arena slots are reused within the extract, drop the stale headers
+        for (int p=0; p<=last; p++)
+        {
+            if (!layer_pending[p])
+                continue;
+
+            const Layer* layer = layers[schedule[p]];
+            for (size_t i=0; i<layer->tops.size(); i++)
+            {
+                if (plan.backed[layer->tops[i]])
+                    blob_mats[layer->tops[i]].release();
+            }
+        }
+    }
+    else if (ret == 0)
+    {
+        extractor->usage_pending.assign(layer_pending.begin(), layer_pending.begin() + last + 1);
+        extractor->usage_requested.assign(blob_indices, blob_indices + count);
+        extractor->usage_lightmode = extractor->lightmode;
+    }
+    extractor->memory_planned = false;
+
+    // forget the consumer counts for the next extract
+    for (int p=0; p<=last; p++)
+    {
+        const Layer* layer = layers[schedule[p]];
+        for (size_t i=0; i<layer->tops.size(); i++)
+            blob_refs[layer->tops[i]] = 0;
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+            blob_refs[layer->bottoms[i]] = 0;
+    }
+
+    return ret;
+}
+
+int Net::plan_memory(Extractor* extractor) const
+{
+    const std::vector<char>& pending = extractor->usage_pending;
+    const std::vector<BlobUsage>& usage = extractor->blob_usage;
+    const int last = (int)pending.size() - 1;
+    if (last < 0)
+        return -1;
+
+    const int blob_count = blobs.size();
+
+    // blobs sharing a buffer form a group led by the owner of the buffer,
+    // only groups produced in full by the planned layers go to the arena
+    std::vector<int> owner(blob_count);
+    std::vector<char> eligible(blob_count, 0);
+    std::vector<int> first(blob_count, -1);
+    std::vector<int> end(blob_count, -1);
+    std::vector<size_t> size(blob_count, 0);
+    for (int i=0; i<blob_count; i++)
+        owner[i] = i;
+
+    for (int p=0; p<=last; p++)
+    {
+        if (!pending[p])
+            continue;
+
+        const Layer* layer = layers[schedule[p]];
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+        {
+            int o = owner[layer->bottoms[i]];
+            end[o] = std::max(end[o], p);
+        }
+
+        for (size_t i=0; i<layer->tops.size(); i++)
+        {
+            int top_blob_index = layer->tops[i];
+            const BlobUsage& u = usage[top_blob_index];
+            if (u.alias != -1)
+            {
+                owner[top_blob_index] = owner[u.alias];
+                continue;
+            }
+
+            if (u.dims == 1)
+                size[top_blob_index] = u.w;
+            else if (u.dims == 2)
+                size[top_blob_index] = (size_t)u.w * u.h;
+            else if (u.dims == 3)
+                size[top_blob_index] = (alignSize(u.w * u.h * sizeof(float), 16) >> 2) * u.c;
+
+            eligible[top_blob_index] = size[top_blob_index] > 0;
+            first[top_blob_index] = p;
+            end[top_blob_index] = p;
+        }
+    }
+
+    // the caller and the cnn cache read these after extract returns
+    for (size_t i=0; i<extractor->usage_requested.size(); i++)
+        eligible[owner[extractor->usage_requested[i]]] = 0;
+#if NCNN_CNNCACHE
+    if (extractor->cache_mode)
+    {
+        for (int p=0; p<=last; p++)
+        {
+            const Layer* layer = layers[schedule[p]];
+            if (pending[p] && layer->needs_cache())
+                eligible[owner[layer->tops[0]]] = 0;
+            if (pending[p] && extractor->feature_epsilon[schedule[p]] > 0.f)
+                eligible[owner[layer->bottoms[0]]] = 0;
+        }
+    }
+#endif // NCNN_CNNCACHE
+
+    // in place layers run as they did when recorded, a light mode run went
+    // over the bottom when it was the last reader and over a copy otherwise
+    // a regular run that did not alias takes over the slot of a bottom it
+    // is the last reader of
+    MemoryPlan& plan = extractor->memory_plan;
+    plan.inplace.assign(layers.size(), 0);
+    for (int p=0; p<=last; p++)
+    {
+        const Layer* layer = layers[schedule[p]];
+        if (!pending[p] || !layer->one_blob_only || !layer->support_inplace)
+            continue;
+
+        int bottom_blob_index = layer->bottoms[0];
+        int top_blob_index = layer->tops[0];
+        bool aliased = usage[top_blob_index].alias == bottom_blob_index;
+        if (extractor->usage_lightmode)
+        {
+            plan.inplace[schedule[p]] = aliased ? 1 : 2;
+            continue;
+        }
+
+        int o = owner[bottom_blob_index];
+        const BlobUsage& b = usage[bottom_blob_index];
+        const BlobUsage& t = usage[top_blob_index];
+        if (aliased || o != bottom_blob_index || !eligible[o] || end[o] != p
+            || owner[top_blob_index] != top_blob_index || !eligible[top_blob_index]
+            || b.dims != t.dims || b.w != t.w || b.h != t.h || b.c != t.c)
+            continue;
+
+        end[o] = end[top_blob_index];
+        eligible[top_blob_index] = 0;
+        plan.inplace[schedule[p]] = 1;
+        for (int i=0; i<blob_count; i++)
+        {
+            if (owner[i] == top_blob_index)
+                owner[i] = o;
+        }
+    }
+
+    // largest first, each group at the lowest offset clear of the groups
+    // alive at the same time
+    std::vector<int> order;
+    for (int i=0; i<blob_count; i++)
+    {
+        if (eligible[i])
+            order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return size[a] > size[b]; });
+
+    std::vector<size_t> offset(blob_count, 0);
+    std::vector<int> placed;
+    size_t arena_size = 0;
+    for (size_t i=0; i<order.size(); i++)
+    {
+        int g = order[i];
+        // slots are 64 bytes aligned for simd loads
+        size_t slot = alignSize(size[g] * sizeof(float), 64) >> 2;
+
+        std::vector<int> live;
+        for (size_t j=0; j<placed.size(); j++)
+        {
+            int h = placed[j];
+            if (first[h] <= end[g] && first[g] <= end[h])
+                live.push_back(h);
+        }
+        std::sort(live.begin(), live.end(), [&](int a, int b) { return offset[a] < offset[b]; });
+
+        size_t o = 0;
+        for (size_t j=0; j<live.size(); j++)
+        {
+            int h = live[j];
+            if (o + slot <= offset[h])
+                break;
+            o = std::max(o, offset[h] + (alignSize(size[h] * sizeof(float), 64) >> 2));
+        }
+
+        offset[g] = o;
+        placed.push_back(g);
+        arena_size = std::max(arena_size, o + slot);
+    }
+
+    plan.arena.release();
+    if (arena_size > 0)
+    {
+        plan.arena.create(arena_size);
+        if (plan.arena.empty())
+            return -100;
+    }
+
+    plan.pending = pending;
+    plan.backed.assign(blob_count, 0);
+    plan.views.assign(blob_count, Mat());
+    for (int i=0; i<blob_count; i++)
+    {
+        if (!eligible[owner[i]])
+            continue;
+
+        plan.backed[i] = 1;
+        if (owner[i] != i || first[i] == -1)
+            continue;
+
+        const BlobUsage& u = usage[i];
+        float* ptr = (float*)plan.arena.data + offset[i];
+        if (u.dims == 1)
+            plan.views[i] = Mat(u.w, ptr);
+        else if (u.dims == 2)
+            plan.views[i] = Mat(u.w, u.h, ptr);
+        else
+            plan.views[i] = Mat(u.w, u.h, u.c, ptr);
+        plan.views[i].arena_view = true;
+    }
+    plan.lightmode = extractor->usage_lightmode;
+#if NCNN_CNNCACHE
+    plan.cache_mode = extractor->cache_mode;
+#endif // NCNN_CNNCACHE
+
+    return 0;
+}
+
+int Net::forward_batch(int input_blob_index, const std::vector<Mat>& inputs, int output_blob_index,
+                       std::vector<Mat>& feats, Extractor* extractor) const
+{
+    const int batch = inputs.size();
+    const bool lightmode = extractor->lightmode;
+
+    // one mat per sample for every blob, the set inputs are shared
+    std::vector< std::vector<Mat> > batch_mats(blobs.size());
+    batch_mats[input_blob_index] = inputs;
+    for (size_t i=0; i<blobs.size(); i++)
+    {
+        const Mat& m = extractor->blob_mats[i];
+        if ((int)i == input_blob_index || m.empty())
+            continue;
+
+        int producer = blobs[i].producer;
+        if (producer != -1 && !layers[producer]->bottoms.empty())
+            continue;
+
+        batch_mats[i].assign(batch, m);
+    }
+
+    if (batch_mats[output_blob_index].empty())
+    {
+        int layer_index = blobs[output_blob_index].producer;
+        if (layer_index == -1 || schedule_pos[layer_index] == -1)
+            return -1;
+
+        // the same backward marking as forward_blobs, on the batch blobs
+        const int last = schedule_pos[layer_index];
+        std::vector<int> refs(blobs.size(), 0);
+        std::vector<char> pending(last + 1, 0);
+        refs[output_blob_index] = 1;
+        for (int p=last; p>=0; p--)
+        {
+            const Layer* layer = layers[schedule[p]];
+            for (size_t i=0; i<layer->tops.size(); i++)
+            {
+                if (refs[layer->tops[i]] != 0 && batch_mats[layer->tops[i]].empty())
+                    pending[p] = 1;
+            }
+
+            if (!pending[p])
+                continue;
+
+            for (size_t i=0; i<layer->bottoms.size(); i++)
+            {
+                refs[layer->bottoms[i]]++;
+            }
+        }
+
+        std::vector<Mat> bottom_blobs;
+        std::vector<Mat> top_blobs;
+        for (int p=0; p<=last; p++)
+        {
+            if (!pending[p])
+                continue;
+
+            // an input layer left pending means an input was never set
+            const Layer* layer = layers[schedule[p]];
+            if (layer->bottoms.empty())
+                return -1;
+
+            for (size_t i=0; i<layer->bottoms.size(); i++)
+            {
+                if ((int)batch_mats[layer->bottoms[i]].size() != batch)
+                    return -1;
+            }
+
+            int ret = 0;
+            if (layer->one_blob_only)
+            {
+                int bottom_blob_index = layer->bottoms[0];
+                int top_blob_index = layer->tops[0];
+
+                bottom_blobs = batch_mats[bottom_blob_index];
+                if (lightmode)
+                {
+                    // delete after the last pending consumer took it in light mode
+                    if (--refs[bottom_blob_index] == 0)
+                        batch_mats[bottom_blob_index].clear();
+                }
+
+                if (lightmode && layer->support_inplace)
+                {
+                    for (int n=0; n<batch && ret == 0; n++)
+                    {
+                        // deep copy for inplace forward if data is shared
+                        if (!bottom_blobs[n].refcount || *bottom_blobs[n].refcount != 1)
+                            bottom_blobs[n] = bottom_blobs[n].clone();
+
+                        ret = layer->forward_inplace(bottom_blobs[n]);
+                    }
+
+                    batch_mats[top_blob_index] = bottom_blobs;
+                }
+                else
+                {
+                    ret = layer->forward_batch(bottom_blobs, top_blobs);
+                    batch_mats[top_blob_index] = top_blobs;
+                }
+            }
+            else
+            {
+                // no weights to share, the samples run one after another
+                for (size_t i=0; i<layer->tops.size(); i++)
+                    batch_mats[layer->tops[i]].resize(batch);
+
+                bottom_blobs.resize(layer->bottoms.size());
+                top_blobs.resize(layer->tops.size());
+                for (int n=0; n<batch && ret == 0; n++)
+                {
+                    for (size_t i=0; i<layer->bottoms.size(); i++)
+                        bottom_blobs[i] = batch_mats[layer->bottoms[i]][n];
+
+                    ret = layer->forward(bottom_blobs, top_blobs);
+
+                    for (size_t i=0; i<layer->tops.size(); i++)
+                    {
+                        batch_mats[layer->tops[i]][n] = top_blobs[i];
+                        top_blobs[i].release();
+                    }
+                }
+
+                if (lightmode)
+                {
+                    for (size_t i=0; i<layer->bottoms.size(); i++)
+                    {
+                        if (--refs[layer->bottoms[i]] == 0)
+                            batch_mats[layer->bottoms[i]].clear();
+                    }
+                }
+            }
+
+            bottom_blobs.clear();
+            top_blobs.clear();
+            if (ret != 0)
+                return ret;
+        }
+    }
+
+    feats = batch_mats[output_blob_index];
+
+    return 0;
+}
+
+int Net::forward_scheduled(int layer_index, Extractor* extractor, const float** ranges, bool concurrent) const
+{
+    const std::vector<Mat>& blob_mats = extractor->blob_mats;
+    const Layer* layer = layers[layer_index];
+    const bool record = !extractor->memory_planned;
+
+    if (record)
+    {
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+        {
+            const Mat& m = blob_mats[layer->bottoms[i]];
+            ranges[i * 2] = m.data;
+            ranges[i * 2 + 1] = m.data + m.total();
+        }
+    }
+
+    const bool profiling = !extractor->layer_times.empty();
+    double start = profiling ? get_current_time() : 0.0;
+
+    int ret = forward_layer(layer_index, extractor, concurrent);
+    if (ret != 0)
+        return ret;
+
+    if (profiling)
+        extractor->layer_times[layer_index] = get_current_time() - start;
+
+    if (record)
+    {
+        // record the shapes and which tops point into a bottom
+        for (size_t i=0; i<layer->tops.size(); i++)
+        {
+            int top_blob_index = layer->tops[i];
+            const Mat& m = blob_mats[top_blob_index];
+            BlobUsage& usage = extractor->blob_usage[top_blob_index];
+            usage.dims = m.dims;
+            usage.w = m.w;
+            usage.h = m.h;
+            usage.c = m.c;
+            usage.alias = -1;
+            for (size_t j=0; j<layer->bottoms.size(); j++)
+            {
+                if (m.data && m.data >= ranges[j * 2] && m.data < ranges[j * 2 + 1])
+                    usage.alias = layer->bottoms[j];
+            }
+        }
+    }
+
+    return 0;
+}
+
+int Net::forward_dataflow(int last, Extractor* extractor) const
+{
+    const std::vector<char>& layer_pending = extractor->layer_pending;
+    ThreadPool* pool = extractor->thread_pool;
+
+    // bottoms whose producer has yet to run, per pending layer by schedule
+    // position, a layer is ready when its count drops to zero
+    std::vector< std::atomic<int> > waiting(last + 1);
+    std::vector<int> ready;
+    for (int p=0; p<=last; p++)
+    {
+        if (!layer_pending[p])
+            continue;
+
+        const Layer* layer = layers[schedule[p]];
+        int count = 0;
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+        {
+            int producer = blobs[layer->bottoms[i]].producer;
+            if (producer != -1 && schedule_pos[producer] <= last && layer_pending[schedule_pos[producer]])
+                count++;
+        }
+
+        waiting[p].store(count);
+        if (count == 0)
+            ready.push_back(p);
+    }
+
+    const int team = ParallelScope::current_threads();
+    const size_t range_count = extractor->usage_ranges.size();
+
+    // tasks handed to the pool and not finished, and those not started yet
+    std::mutex lock;
+    std::condition_variable cond;
+    int inflight = 0;
+    int queued = 0;
+    std::atomic<int> running(0);
+    std::atomic<int> error(0);
+
+    std::function<void(int)> run;
+    std::function<void(int)> spawn = [&](int p)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            inflight++;
+            queued++;
+        }
+        pool->enqueue([&, p]() {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                queued--;
+            }
+            run(p);
+        });
+        cond.notify_all();
+    };
+
+    run = [&](int p)
+    {
+        std::vector<const float*> ranges(range_count);
+
+        // a finished layer continues with the first consumer it made ready
+        // on this thread and hands the others to the pool
+        while (p != -1)
+        {
+            int next = -1;
+            if (error.load() == 0)
+            {
+                int ret;
+                {
+                    const int share = std::max(1, team / ++running);
+                    ParallelScope parallel(pool, share);
+#ifdef _OPENMP
+                    int threads_current = omp_get_max_threads();
+                    omp_set_num_threads(share);
+#endif
+                    ret = forward_scheduled(schedule[p], extractor, ranges.empty() ? 0 : &ranges[0], true);
+#ifdef _OPENMP
+                    omp_set_num_threads(threads_current);
+#endif
+                    running--;
+                }
+                if (ret != 0)
+                {
+                    int expected = 0;
+                    error.compare_exchange_strong(expected, ret);
+                }
+                else
+                {
+                    const Layer* layer = layers[schedule[p]];
+                    for (size_t i=0; i<layer->tops.size(); i++)
+                    {
+                        const Blob& blob = blobs[layer->tops[i]];
+                        for (size_t j=0; j<blob.consumers.size(); j++)
+                        {
+                            int q = schedule_pos[blob.consumers[j]];
+                            if (q > last || !layer_pending[q])
+                                continue;
+
+                            if (--waiting[q] != 0)
+                                continue;
+
+                            if (next == -1)
+                                next = q;
+                            else
+                                spawn(q);
+                        }
+                    }
+                }
+            }
+
+            p = next;
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        inflight--;
+        cond.notify_all();
+    };
+
+    for (size_t i=0; i<ready.size(); i++)
+    {
+        spawn(ready[i]);
+    }
+
+    // help with the queued layers instead of blocking, so the extract
+    // still makes progress when the pool is busy or has no workers
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [&]{ return inflight == 0 || queued != 0; });
+            if (inflight == 0)
+                break;
+        }
+
+        pool->run_one();
+    }
+
+    return error.load();
+}
+
+int Net::forward_layer(int layer_index, Extractor* extractor, bool concurrent) const
+{
+    bool lightmode = extractor->lightmode;
+    std::vector<Mat>& blob_mats = extractor->blob_mats;
+    std::vector<int>& blob_refs = extractor->blob_refs;
+    const MemoryPlan& plan = extractor->memory_plan;
+    const bool planned = extractor->memory_planned;
+    const Layer* layer = layers[layer_index];
+    int ret;
+
+// #if NCNN_CNNCACHE
+//     LOGI("Net::forward_layer index: %d name: %s type: %s\n",
+//         layer_index, layer->name.c_str(), layer->type.c_str());
+// #endif
+    // fprintf(stderr, "forward_layer %d %s\n", layer_index, layer->name.c_str());
+
+    if (layer->one_blob_only)
+    {
+        // load bottom blob
+        int bottom_blob_index = layer->bottoms[0];
+        int top_blob_index = layer->tops[0];
+
+        // LOGI("Net::forward_layer index: %d name: %s type: %s\n",
+        //     layer_index, layer->name.c_str(), layer->type.c_str());
+
+        Mat bottom_blob = blob_mats[bottom_blob_index];
+
+        // forward over the bottom in light mode or where the memory plan says so
+        bool inplace = planned ? plan.inplace[layer_index] != 0 : lightmode && layer->support_inplace;
+
+        if (lightmode)
+        {
+            // delete after the last pending consumer took it in light mode
+            if (NCNN_XADD(&blob_refs[bottom_blob_index], -1) == 1)
+                blob_mats[bottom_blob_index].release();
+        }
+        if (inplace && planned && plan.inplace[layer_index] == 2)
+        {
+            // inplace forward over a copy in the top's own slot
+            const Mat& slot = plan.views[top_blob_index];
+            if (slot.dims == bottom_blob.dims && slot.w == bottom_blob.w && slot.h == bottom_blob.h && slot.c == bottom_blob.c)
+            {
+                Mat copy = slot;
+                memcpy(copy.data, bottom_blob.data, bottom_blob.total() * sizeof(float));
+                bottom_blob = copy;
+            }
+            else
+            {
+                bottom_blob = bottom_blob.clone();
+            }
+        }
+        else if (inplace && (bottom_blob.refcount ? *bottom_blob.refcount != 1 : !planned))
+        {
+            // deep copy for inplace forward if data is shared, planned arena blobs are not
+            bottom_blob = bottom_blob.clone();
+        }
+
+#if NCNN_CNNCACHE
+        MRect& bottom_mrect = extractor->matched_rects[bottom_blob_index];
+        const float feature_eps = extractor->feature_epsilon[layer_index];
+        if (extractor->cache_mode && feature_eps > 0.f && !bottom_mrect.affine && bottom_mrect.size() > 0)
+        {
+            // shrink the dirty set to where the input really moved away from the cache
+            extractor->commit_handle.wait(layer_index);
+            const Mat& cached_bottom = extractor->blob_mats_input_cached[layer_index];
+            if (cached_bottom.dims == bottom_blob.dims && cached_bottom.c == bottom_blob.c)
+            {
+                MRect mrect;
+                bottom_mrect.shrink_by_feature(bottom_blob, cached_bottom, feature_eps, mrect);
+                ret = layer->forward_mrect(mrect, extractor->matched_rects[top_blob_index]);
+            }
+            else
+            {
+                ret = layer->forward_mrect(bottom_mrect, extractor->matched_rects[top_blob_index]);
+            }
+        }
+        else
+        {
+            ret = layer->forward_mrect(bottom_mrect, extractor->matched_rects[top_blob_index]);
+        }
+        if (ret != 0)
+            NCNN_LOGE("Failing forward_mrect: %d", ret);
+#endif
+
+        // forward
+        if (inplace)
+        {
+            Mat& bottom_top_blob = bottom_blob;
+            ret = layer->forward_inplace(bottom_top_blob);
+            if (ret != 0)
+                return ret;
+
+            // store top blob
+            blob_mats[top_blob_index] = bottom_top_blob;
+        }
+        else
+        {
+            Mat top_blob;
+            if (planned)
+                top_blob = plan.views[top_blob_index];
+#if NCNN_CNNCACHE
+            // TODO: we should add this every place forward func is called but
+            // conv is one_blob_only and has no light impl it's enough we impl here
+            if (extractor->cache_mode) {
+                // fence on a commit still running in the background
+                extractor->commit_handle.wait(layer_index);
+                MRect& top_mrect = extractor->matched_rects[top_blob_index];
+                const float min_psnr = extractor->reuse_psnr[layer_index];
+                MRect filtered_mrect;
+                MRect* mrect = &top_mrect;
+                if (min_psnr > 0.f && !top_mrect.matched_vecs.empty()) {
+                    // recompute the poorly matched blocks in this layer only
+                    top_mrect.filter_by_quality(min_psnr, filtered_mrect);
+                    mrect = &filtered_mrect;
+                }
+                if (layer_index == extractor->patch_cache_layer) {
+                    ret = extractor->patch_cache.forward(layer, bottom_blob, top_blob, *mrect,
+                        extractor->blob_mats_cached[layer_index]);
+                }
+                else {
+                    ret = layer->forward_cached(bottom_blob, top_blob, *mrect,
+                        extractor->blob_mats_cached[layer_index]);
+                }
+            }
+            else {
+                ret = layer->forward(bottom_blob, top_blob);
+            }
+#else
+            ret = layer->forward(bottom_blob, top_blob);
+#endif
+            if (ret != 0)
+                return ret;
 
             // store top blob
             blob_mats[top_blob_index] = top_blob;
@@ -627,24 +1954,21 @@ int Net::forward_layer(int layer_index, Extractor* extractor) const
     }
     else
     {
+        // the memory plan keeps multi blob layers out of place
+        bool inplace = !planned && lightmode && layer->support_inplace;
+
         // load bottom blobs
-        std::vector<Mat> bottom_blobs;
-        bottom_blobs.resize(layer->bottoms.size());
+        // concurrent layers must not share the scratch, they use their own
+        std::vector<Mat> bottom_local(concurrent ? layer->bottoms.size() : 0);
+        std::vector<Mat>& bottom_blobs = concurrent ? bottom_local : extractor->bottom_scratch[layer->bottoms.size()];
 #if NCNN_CNNCACHE
-        std::vector<MRect> bottom_mrects;
-        bottom_mrects.resize(layer->bottoms.size());
+        std::vector<MRect> bottom_mrect_local(concurrent ? layer->bottoms.size() : 0);
+        std::vector<MRect>& bottom_mrects = concurrent ? bottom_mrect_local : extractor->bottom_mrect_scratch[layer->bottoms.size()];
 #endif
         for (size_t i=0; i<layer->bottoms.size(); i++)
         {
             int bottom_blob_index = layer->bottoms[i];
 
-            if (blob_mats[bottom_blob_index].dims == 0)
-            {
-                ret = forward_layer(blobs[bottom_blob_index].producer, extractor);
-                if (ret != 0)
-                    return ret;
-            }
-
             bottom_blobs[i] = blob_mats[bottom_blob_index];
 
 #if NCNN_CNNCACHE
@@ -652,22 +1976,26 @@ int Net::forward_layer(int layer_index, Extractor* extractor) const
 #endif
             if (lightmode)
             {
-                // delete after taken in light mode
-                blob_mats[bottom_blob_index].release();
-                // deep copy for inplace forward if data is shared
-                if (layer->support_inplace && *bottom_blobs[i].refcount != 1)
-                {
-                    bottom_blobs[i] = bottom_blobs[i].clone();
-                }
+                // delete after the last pending consumer took it in light mode
+                if (NCNN_XADD(&blob_refs[bottom_blob_index], -1) == 1)
+                    blob_mats[bottom_blob_index].release();
+            }
+            // deep copy for inplace forward if data is shared
+            if (inplace && (!bottom_blobs[i].refcount || *bottom_blobs[i].refcount != 1))
+            {
+                bottom_blobs[i] = bottom_blobs[i].clone();
             }
         }
 
 #if NCNN_CNNCACHE
-        std::vector<MRect> top_mrects;
-        top_mrects.resize(layer->tops.size());
+        std::vector<MRect> top_mrect_local(concurrent ? layer->tops.size() : 0);
+        std::vector<MRect>& top_mrects = concurrent ? top_mrect_local : extractor->top_mrect_scratch[layer->tops.size()];
+        // forward_mrect appends, the scratch still holds the previous layer's rects
+        for (size_t i=0; i<top_mrects.size(); i++)
+            top_mrects[i] = MRect();
         ret = layer->forward_mrect(bottom_mrects, top_mrects);
         if (ret != 0)
-            LOGE("Failing forward_mrect: %d", ret);
+            NCNN_LOGE("Failing forward_mrect: %d", ret);
         for (size_t i=0; i<layer->tops.size(); i++)
         {
             int top_blob_index = layer->tops[i];
@@ -676,7 +2004,7 @@ int Net::forward_layer(int layer_index, Extractor* extractor) const
 #endif
 
         // forward
-        if (lightmode && layer->support_inplace)
+        if (inplace)
         {
             std::vector<Mat>& bottom_top_blobs = bottom_blobs;
             ret = layer->forward_inplace(bottom_top_blobs);
@@ -693,49 +2021,240 @@ int Net::forward_layer(int layer_index, Extractor* extractor) const
         }
         else
         {
-            std::vector<Mat> top_blobs;
-            top_blobs.resize(layer->tops.size());
-            ret = layer->forward(bottom_blobs, top_blobs);
+            std::vector<Mat> top_local(concurrent ? layer->tops.size() : 0);
+            std::vector<Mat>& top_blobs = concurrent ? top_local : extractor->top_scratch[layer->tops.size()];
+            if (planned)
+            {
+                for (size_t i=0; i<layer->tops.size(); i++)
+                    top_blobs[i] = plan.views[layer->tops[i]];
+            }
+            // only recurrent layers keep state, the others stay on the cached path
+            if (extractor->streaming && layer->support_stateful)
+                ret = layer->forward_stateful(bottom_blobs, top_blobs, extractor->layer_states[layer_index]);
+#if NCNN_CNNCACHE
+            else if (extractor->cache_mode && layer->needs_cache())
+            {
+                extractor->commit_handle.wait(layer_index);
+                ret = layer->forward_cached(bottom_blobs, top_blobs, extractor->matched_rects[layer->tops[0]],
+                    extractor->blob_mats_cached[layer_index]);
+            }
+#endif
+            else
+                ret = layer->forward(bottom_blobs, top_blobs);
             if (ret != 0)
                 return ret;
 
-            // store top blobs
-            for (size_t i=0; i<layer->tops.size(); i++)
-            {
-                int top_blob_index = layer->tops[i];
+            // store top blobs
+            for (size_t i=0; i<layer->tops.size(); i++)
+            {
+                int top_blob_index = layer->tops[i];
+
+                blob_mats[top_blob_index] = top_blobs[i];
+                top_blobs[i].release();
+            }
+        }
+
+        // drop the scratch references so light mode can recycle the bottoms
+        for (size_t i=0; i<layer->bottoms.size(); i++)
+        {
+            bottom_blobs[i].release();
+        }
+    }
+
+//     fprintf(stderr, "forward_layer %d %s done\n", layer_index, layer->name.c_str());
+//     const Mat& blob = blob_mats[layer->tops[0]];
+//     fprintf(stderr, "[%-2d %-16s %-16s]  %d    blobs count = %-3d   size = %-3d x %-3d\n", layer_index, layer->type.c_str(), layer->name.c_str(), layer->tops[0], blob.c, blob.h, blob.w);
+
+    return 0;
+}
+
+// thread count of the parallel_for loops and OpenMP teams started by the
+// calling thread for the length of one extract, the settings are per thread so extractors running
+// on other threads keep theirs, and the previous ones are restored on exit
+class ThreadScope
+{
+public:
+    ThreadScope(const Extractor* extractor)
+        : pool(extractor->thread_pool)
+        , share(pool->enter())
+        , parallel(pool, extractor->num_threads ? extractor->num_threads : share)
+    {
+#ifdef _OPENMP
+        dynamic_current = omp_get_dynamic();
+        num_threads_current = omp_get_max_threads();
+        omp_set_dynamic(0);
+        omp_set_num_threads(extractor->num_threads ? extractor->num_threads : share);
+#endif
+    }
+
+    ~ThreadScope()
+    {
+#ifdef _OPENMP
+        omp_set_dynamic(dynamic_current);
+        omp_set_num_threads(num_threads_current);
+#endif
+        pool->leave();
+    }
+
+private:
+    ThreadPool* pool;
+    int share;
+    ParallelScope parallel;
+#ifdef _OPENMP
+    int dynamic_current;
+    int num_threads_current;
+#endif
+};
+
+Extractor::Extractor(const Net* _net, int blob_count) : net(_net)
+{
+    blob_mats.resize(blob_count);
+    lightmode = false;
+    num_threads = 0;
+    thread_pool = ThreadPool::shared();
+    branch_parallel = false;
+    streaming = false;
+    layer_states.resize(net->layers.size());
+
+    layer_pending.resize(net->layers.size(), 0);
+    blob_refs.resize(blob_count, 0);
+    size_t max_bottoms = 0;
+    size_t max_tops = 0;
+    for (size_t i=0; i<net->layers.size(); i++)
+    {
+        if (!net->layers[i])
+            continue;
+        max_bottoms = std::max(max_bottoms, net->layers[i]->bottoms.size());
+        max_tops = std::max(max_tops, net->layers[i]->tops.size());
+    }
+    blob_usage.resize(blob_count);
+    usage_ranges.resize(max_bottoms * 2);
+    usage_lightmode = false;
+    memory_planned = false;
+    memory_plan.lightmode = false;
+    memory_plan.cache_mode = false;
+
+    bottom_scratch.resize(max_bottoms + 1);
+    for (size_t i=0; i<=max_bottoms; i++)
+        bottom_scratch[i].resize(i);
+    top_scratch.resize(max_tops + 1);
+    for (size_t i=0; i<=max_tops; i++)
+        top_scratch[i].resize(i);
+#if NCNN_CNNCACHE
+    bottom_mrect_scratch.resize(max_bottoms + 1);
+    for (size_t i=0; i<=max_bottoms; i++)
+        bottom_mrect_scratch[i].resize(i);
+    top_mrect_scratch.resize(max_tops + 1);
+    for (size_t i=0; i<=max_tops; i++)
+        top_mrect_scratch[i].resize(i);
+#endif
+#if NCNN_CNNCACHE
+    blob_mats_cached.resize(net->layers.size());
+    matched_rects.resize(blob_count);
+    reuse_psnr.resize(net->layers.size(), 0.f);
+    feature_epsilon.resize(net->layers.size(), 0.f);
+    blob_mats_input_cached.resize(net->layers.size());
+    patch_cache_layer = -1;
+    cache_mode = true;
+#endif
+}
+
+Extractor::~Extractor()
+{
+#if NCNN_CNNCACHE
+    // the worker writes into blob_mats_cached, which is destroyed first
+    commit_handle.wait_all();
+#endif
+}
+
+void Extractor::set_light_mode(bool enable)
+{
+    lightmode = enable;
+}
+
+void Extractor::set_num_threads(int _num_threads)
+{
+    num_threads = _num_threads;
+}
+
+void Extractor::set_thread_pool(ThreadPool* pool)
+{
+    thread_pool = pool ? pool : ThreadPool::shared();
+}
+
+void Extractor::set_branch_parallel(bool enable)
+{
+    branch_parallel = enable;
+}
+
+void Extractor::set_streaming(bool enable)
+{
+    streaming = enable;
+}
 
-                blob_mats[top_blob_index] = top_blobs[i];
-            }
-        }
-    }
+void Extractor::set_profiling(bool enable)
+{
+    if (enable)
+        layer_times.resize(net->layers.size(), 0.0);
+    else
+        layer_times.clear();
+}
 
-//     fprintf(stderr, "forward_layer %d %s done\n", layer_index, layer->name.c_str());
-//     const Mat& blob = blob_mats[layer->tops[0]];
-//     fprintf(stderr, "[%-2d %-16s %-16s]  %d    blobs count = %-3d   size = %-3d x %-3d\n", layer_index, layer->type.c_str(), layer->name.c_str(), layer->tops[0], blob.c, blob.h, blob.w);
+int Extractor::reset_state()
+{
+    for (size_t i=0; i<layer_states.size(); i++)
+    {
+        layer_states[i].clear();
+    }
 
     return 0;
 }
 
-Extractor::Extractor(const Net* _net, int blob_count) : net(_net)
+int Extractor::reset_state(int layer_index)
 {
-    blob_mats.resize(blob_count);
-    lightmode = false;
-    num_threads = 0;
-#if NCNN_CNNCACHE
-    blob_mats_cached.resize(net->layers.size());
-    matched_rects.resize(blob_count);
-    cache_mode = true;
-#endif
+    if (layer_index < 0 || layer_index >= (int)layer_states.size())
+        return -1;
+
+    layer_states[layer_index].clear();
+
+    return 0;
 }
 
-void Extractor::set_light_mode(bool enable)
+int Extractor::checkpoint_state()
 {
-    lightmode = enable;
+    layer_states_checkpoint.resize(layer_states.size());
+    for (size_t i=0; i<layer_states.size(); i++)
+    {
+        const std::vector<Mat>& states = layer_states[i];
+        std::vector<Mat>& saved = layer_states_checkpoint[i];
+        saved.resize(states.size());
+        for (size_t j=0; j<states.size(); j++)
+        {
+            saved[j] = states[j].clone();
+        }
+    }
+
+    return 0;
 }
 
-void Extractor::set_num_threads(int _num_threads)
+int Extractor::restore_state()
 {
-    num_threads = _num_threads;
+    if (layer_states_checkpoint.size() != layer_states.size())
+        return -1;
+
+    for (size_t i=0; i<layer_states.size(); i++)
+    {
+        const std::vector<Mat>& saved = layer_states_checkpoint[i];
+        std::vector<Mat>& states = layer_states[i];
+        states.resize(saved.size());
+        for (size_t j=0; j<saved.size(); j++)
+        {
+            // keep the checkpoint intact for another restore
+            states[j] = saved[j].clone();
+        }
+    }
+
+    return 0;
 }
 
 int Extractor::input(int blob_index, const Mat& in)
@@ -749,7 +2268,7 @@ int Extractor::input(int blob_index, const Mat& in)
 }
 
 #if NCNN_CNNCACHE
-int Extractor::input_mrect(int blob_index, MRect& mrect)
+int Extractor::input_mrect(int blob_index, const MRect& mrect)
 {
     if (blob_index < 0 || blob_index >= (int)blob_mats.size())
         return -1;
@@ -758,7 +2277,7 @@ int Extractor::input_mrect(int blob_index, MRect& mrect)
 
     return 0;
 }
-int Extractor::input_mrect(const char* blob_name, MRect& mrect)
+int Extractor::input_mrect(const char* blob_name, const MRect& mrect)
 {
     int blob_index = net->find_blob_index_by_name(blob_name);
     if (blob_index < 0 || blob_index >= (int)blob_mats.size())
@@ -768,6 +2287,65 @@ int Extractor::input_mrect(const char* blob_name, MRect& mrect)
 
     return 0;
 }
+int Extractor::set_reuse_quality(int layer_index, float min_psnr)
+{
+    if (layer_index < 0 || layer_index >= (int)reuse_psnr.size())
+        return -1;
+
+    reuse_psnr[layer_index] = min_psnr;
+
+    return 0;
+}
+#if NCNN_STRING
+int Extractor::set_reuse_quality(const char* layer_name, float min_psnr)
+{
+    int layer_index = net->find_layer_index_by_name(layer_name);
+    return set_reuse_quality(layer_index, min_psnr);
+}
+#endif // NCNN_STRING
+int Extractor::set_feature_epsilon(int layer_index, float eps)
+{
+    if (layer_index < 0 || layer_index >= (int)feature_epsilon.size())
+        return -1;
+
+    if (!net->layers[layer_index]->one_blob_only)
+        return -1;
+
+    feature_epsilon[layer_index] = eps;
+
+    return 0;
+}
+#if NCNN_STRING
+int Extractor::set_feature_epsilon(const char* layer_name, float eps)
+{
+    int layer_index = net->find_layer_index_by_name(layer_name);
+    return set_feature_epsilon(layer_index, eps);
+}
+#endif // NCNN_STRING
+int Extractor::set_patch_cache(int layer_index, int tile, int capacity)
+{
+    if (layer_index < 0 || layer_index >= (int)net->layers.size())
+        return -1;
+
+    const Layer* layer = net->layers[layer_index];
+    int kernel_extent;
+    int stride;
+    int pad;
+    if (!layer->one_blob_only || !layer->needs_cache() || !layer->input_window(kernel_extent, stride, pad))
+        return -1;
+
+    patch_cache.configure(tile, capacity);
+    patch_cache_layer = layer_index;
+
+    return 0;
+}
+#if NCNN_STRING
+int Extractor::set_patch_cache(const char* layer_name, int tile, int capacity)
+{
+    int layer_index = net->find_layer_index_by_name(layer_name);
+    return set_patch_cache(layer_index, tile, capacity);
+}
+#endif // NCNN_STRING
 int Extractor::clear_blob_data()
 {
     // int total_size = 0;
@@ -780,6 +2358,10 @@ int Extractor::clear_blob_data()
 }
 int Extractor::update_cnncache()
 {
+    commit_handle.wait_all();
+    // recurrent state belongs to the same frame as the cache
+    if (streaming)
+        checkpoint_state();
     // int cached_size = 0;
     // struct timeval tv_begin, tv_end;
     // gettimeofday(&tv_begin, NULL);
@@ -790,9 +2372,13 @@ int Extractor::update_cnncache()
             int top_blob_index = layer->tops[0];
             Mat& top_blob = blob_mats[top_blob_index];
             // LOGI("PPP %p %p", top_blob.data, cache_blob.data);
-            cache_blob.cloneFrom(top_blob);
+            snapshot_blob(cache_blob, top_blob);
             // cached_size += top_blob.total();
         }
+        if (feature_epsilon[i] > 0.f) {
+            int bottom_blob_index = layer->bottoms[0];
+            snapshot_blob(blob_mats_input_cached[i], blob_mats[bottom_blob_index]);
+        }
     }
     // LOGI("CACHE_SIZE: %d", cached_size);
     // gettimeofday(&tv_end, NULL);
@@ -800,17 +2386,114 @@ int Extractor::update_cnncache()
     // LOGI("update_cnncache elapsed: %d", elapsed);
     return 0;
 }
+int Extractor::update_cnncache_async()
+{
+    if (streaming)
+        checkpoint_state();
+
+    if (!commit_handle.committer)
+        commit_handle.committer = new CacheCommitter(net->layers.size());
+
+    for (size_t i = 0, max = net->layers.size(); i < max; i ++) {
+        Layer* layer = net->layers[i];
+        if (layer->needs_cache()) {
+            int top_blob_index = layer->tops[0];
+            commit_handle.committer->commit(i, blob_mats[top_blob_index], &blob_mats_cached[i]);
+        }
+        if (feature_epsilon[i] > 0.f) {
+            int bottom_blob_index = layer->bottoms[0];
+            commit_handle.committer->commit(i, blob_mats[bottom_blob_index], &blob_mats_input_cached[i]);
+        }
+    }
+    return 0;
+}
+int Extractor::share_cnncache(const Extractor& keyframe)
+{
+    if (keyframe.net != net)
+        return -1;
+
+    keyframe.commit_handle.wait_all();
+
+    // references only, snapshots never write into a shared cache
+    blob_mats_cached = keyframe.blob_mats_cached;
+    blob_mats_input_cached = keyframe.blob_mats_input_cached;
+    reuse_psnr = keyframe.reuse_psnr;
+    feature_epsilon = keyframe.feature_epsilon;
+
+    return 0;
+}
+int Extractor::extract_parallel(int input_blob_index, const std::vector<Mat>& frames, const std::vector<MRect>& mrects,
+                                int output_blob_index, std::vector<Mat>& feats, int num_workers)
+{
+    if (input_blob_index < 0 || input_blob_index >= (int)blob_mats.size())
+        return -1;
+    if (output_blob_index < 0 || output_blob_index >= (int)blob_mats.size())
+        return -1;
+    if (frames.size() != mrects.size())
+        return -1;
+
+    const int frame_count = frames.size();
+    feats.resize(frame_count);
+    if (frame_count == 0)
+        return 0;
+
+    if (num_workers <= 0)
+        num_workers = thread_pool->concurrency();
+    num_workers = std::min(num_workers, frame_count);
+
+    // split the cores between the workers instead of nesting full teams
+    const int worker_threads = std::max(1, (num_threads ? num_threads : thread_pool->concurrency()) / num_workers);
+
+    std::vector<int> rets(frame_count, 0);
+    thread_pool->run(num_workers, [&](int t) {
+        // one follower per worker, reused for its frames
+        Extractor follower = net->create_extractor();
+        follower.set_light_mode(lightmode);
+        follower.set_num_threads(worker_threads);
+        follower.set_thread_pool(thread_pool);
+        follower.set_cache_mode(cache_mode);
+        follower.share_cnncache(*this);
+
+        for (int i = t; i < frame_count; i += num_workers)
+        {
+            follower.clear_blob_data();
+            follower.input_mrect(input_blob_index, mrects[i]);
+            follower.input(input_blob_index, frames[i]);
+            rets[i] = follower.extract(output_blob_index, feats[i]);
+        }
+    });
+
+    for (int i = 0; i < frame_count; i++)
+    {
+        if (rets[i] != 0)
+            return rets[i];
+    }
+
+    return 0;
+}
+#if NCNN_STRING
+int Extractor::extract_parallel(const char* input_name, const std::vector<Mat>& frames, const std::vector<MRect>& mrects,
+                                const char* output_name, std::vector<Mat>& feats, int num_workers)
+{
+    int input_blob_index = net->find_blob_index_by_name(input_name);
+    int output_blob_index = net->find_blob_index_by_name(output_name);
+    return extract_parallel(input_blob_index, frames, mrects, output_blob_index, feats, num_workers);
+}
+#endif // NCNN_STRING
 int Extractor::clear_cnncache()
 {
+    commit_handle.wait_all();
     for (Mat& mat : blob_mats_cached)
         mat.release();
+    for (Mat& mat : blob_mats_input_cached)
+        mat.release();
     return 0;
 }
 #endif
 
 int Extractor::extract(int blob_index, Mat& feat)
 {
-    log_time_end("__reset");
+    log_time_reset();
     if (blob_index < 0 || blob_index >= (int)blob_mats.size())
         return -1;
 
@@ -818,36 +2501,140 @@ int Extractor::extract(int blob_index, Mat& feat)
 
     if (blob_mats[blob_index].dims == 0)
     {
-        int layer_index = net->blobs[blob_index].producer;
+        ThreadScope scope(this);
+        ret = net->forward_blobs(&blob_index, 1, this);
+    }
+
+    feat = blob_mats[blob_index];
+
+    return ret;
+}
+
+int Extractor::extract_async(int blob_index, const std::function<void(int, const Mat&)>& callback)
+{
+    if (blob_index < 0 || blob_index >= (int)blob_mats.size())
+        return -1;
+
+    const Net* _net = net;
+    _net->begin_async(thread_pool);
+
+    // the callback may destroy the extractor, leave it alone afterwards
+    std::function<void()> task = [this, _net, blob_index, callback]() {
+        Mat feat;
+        int ret = extract(blob_index, feat);
+        callback(ret, feat);
+        _net->end_async();
+    };
+
+    if (thread_pool->size() == 0)
+        task();
+    else
+        thread_pool->enqueue(task);
+
+    return 0;
+}
+
+std::future<int> Extractor::extract_async(int blob_index, Mat& feat)
+{
+    std::shared_ptr< std::promise<int> > promise = std::make_shared< std::promise<int> >();
+    std::future<int> future = promise->get_future();
+
+    Mat* out = &feat;
+    int ret = extract_async(blob_index, [promise, out](int result, const Mat& m) {
+        *out = m;
+        promise->set_value(result);
+    });
+    if (ret != 0)
+        promise->set_value(ret);
+
+    return future;
+}
+
+int Extractor::extract(const std::vector<int>& blob_indices, std::vector<Mat>& feats)
+{
+    log_time_reset();
+    for (size_t i=0; i<blob_indices.size(); i++)
+    {
+        if (blob_indices[i] < 0 || blob_indices[i] >= (int)blob_mats.size())
+            return -1;
+    }
 
-#ifdef _OPENMP
-        int dynamic_current = 0;
-        int num_threads_current = 1;
-        if (num_threads)
-        {
-            dynamic_current = omp_get_dynamic();
-            num_threads_current = omp_get_num_threads();
-            omp_set_dynamic(0);
-            omp_set_num_threads(num_threads);
-        }
-#endif
+    int ret = 0;
 
-        ret = net->forward_layer(layer_index, this);
+    if (!blob_indices.empty())
+    {
+        ThreadScope scope(this);
 
-#ifdef _OPENMP
-        if (num_threads)
-        {
-            omp_set_dynamic(dynamic_current);
-            omp_set_num_threads(num_threads_current);
-        }
-#endif
+        // one pass over the schedule, shared producers run once
+        ret = net->forward_blobs(&blob_indices[0], blob_indices.size(), this);
     }
 
-    feat = blob_mats[blob_index];
+    feats.resize(blob_indices.size());
+    for (size_t i=0; i<blob_indices.size(); i++)
+    {
+        feats[i] = blob_mats[blob_indices[i]];
+    }
 
     return ret;
 }
 
+int Extractor::extract_batch(int input_blob_index, const std::vector<Mat>& inputs, int output_blob_index, std::vector<Mat>& feats)
+{
+    log_time_reset();
+    if (input_blob_index < 0 || input_blob_index >= (int)blob_mats.size())
+        return -1;
+    if (output_blob_index < 0 || output_blob_index >= (int)blob_mats.size())
+        return -1;
+
+    feats.clear();
+    if (inputs.empty())
+        return 0;
+
+    ThreadScope scope(this);
+    return net->forward_batch(input_blob_index, inputs, output_blob_index, feats, this);
+}
+
+int Extractor::plan_memory()
+{
+    clear_memory_plan();
+    return net->plan_memory(this);
+}
+
+void Extractor::clear_memory_plan()
+{
+    memory_plan.pending.clear();
+    memory_plan.inplace.clear();
+    memory_plan.backed.clear();
+    memory_plan.views.clear();
+    memory_plan.arena.release();
+}
+
+size_t Extractor::memory_plan_size() const
+{
+    return memory_plan.arena.total() * sizeof(float);
+}
+
+int Extractor::infer_shape(std::vector<MatShape>& blob_shapes) const
+{
+    // the blobs fed through input, not the intermediates of a past extract
+    std::vector<int> input_blob_indices;
+    std::vector<MatShape> input_shapes;
+    for (size_t i=0; i<blob_mats.size(); i++)
+    {
+        if (blob_mats[i].empty())
+            continue;
+
+        int producer = net->blobs[i].producer;
+        if (producer != -1 && !net->layers[producer]->bottoms.empty())
+            continue;
+
+        input_blob_indices.push_back(i);
+        input_shapes.push_back(blob_mats[i].shape());
+    }
+
+    return net->infer_shape(input_blob_indices, input_shapes, blob_shapes);
+}
+
 #if NCNN_STRING
 int Extractor::input(const char* blob_name, const Mat& in)
 {
@@ -865,6 +2652,124 @@ int Extractor::extract(const char* blob_name, Mat& feat)
     int blob_index = net->find_blob_index_by_name(blob_name);
     return extract(blob_index, feat);
 }
+
+int Extractor::extract_async(const char* blob_name, const std::function<void(int, const Mat&)>& callback)
+{
+    int blob_index = net->find_blob_index_by_name(blob_name);
+    return extract_async(blob_index, callback);
+}
+
+int Extractor::extract(const std::vector<const char*>& blob_names, std::vector<Mat>& feats)
+{
+    std::vector<int> blob_indices(blob_names.size());
+    for (size_t i=0; i<blob_names.size(); i++)
+    {
+        blob_indices[i] = net->find_blob_index_by_name(blob_names[i]);
+        if (blob_indices[i] == -1)
+            return -1;
+    }
+
+    return extract(blob_indices, feats);
+}
+
+std::future<int> Extractor::extract_async(const char* blob_name, Mat& feat)
+{
+    int blob_index = net->find_blob_index_by_name(blob_name);
+    return extract_async(blob_index, feat);
+}
+
+int Extractor::extract_batch(const char* input_name, const std::vector<Mat>& inputs, const char* output_name, std::vector<Mat>& feats)
+{
+    int input_blob_index = net->find_blob_index_by_name(input_name);
+    int output_blob_index = net->find_blob_index_by_name(output_name);
+    if (input_blob_index == -1 || output_blob_index == -1)
+        return -1;
+
+    return extract_batch(input_blob_index, inputs, output_blob_index, feats);
+}
+
+int Extractor::input_from(const char* blob_name, Extractor& trunk, const char* trunk_blob_name)
+{
+    int blob_index = net->find_blob_index_by_name(blob_name);
+    int trunk_blob_index = trunk.net->find_blob_index_by_name(trunk_blob_name);
+    return input_from(blob_index, trunk, trunk_blob_index);
+}
+#endif // NCNN_STRING
+
+int Extractor::input_from(int blob_index, Extractor& trunk, int trunk_blob_index)
+{
+    if (blob_index < 0 || blob_index >= (int)blob_mats.size())
+        return -1;
+
+    // computed once by the trunk, shared here by reference
+    Mat feat;
+    int ret = trunk.extract(trunk_blob_index, feat);
+    if (ret != 0)
+        return ret;
+
+    blob_mats[blob_index] = feat;
+
+#if NCNN_CNNCACHE
+    // the dirty set of the trunk output drives the cached layers of this head
+    matched_rects[blob_index].copyFrom(trunk.matched_rects[trunk_blob_index]);
+#endif
+
+    return 0;
+}
+
+#if NCNN_STRING
+int Extractor::input_pixels(const char* blob_name, const unsigned char* pixels, int type, int w, int h,
+                            const float* mean_vals, const float* norm_vals)
+{
+    int blob_index = net->find_blob_index_by_name(blob_name);
+    return input_pixels(blob_index, pixels, type, w, h, mean_vals, norm_vals);
+}
 #endif // NCNN_STRING
 
+int Extractor::input_pixels(int blob_index, const unsigned char* pixels, int type, int w, int h,
+                            const float* mean_vals, const float* norm_vals)
+{
+    if (blob_index < 0 || blob_index >= (int)blob_mats.size())
+        return -1;
+
+    const Blob& blob = net->blobs[blob_index];
+    int layer_index = blob.consumers.size() == 1 ? blob.consumers[0] : -1;
+    const Layer* layer = layer_index != -1 ? net->layers[layer_index] : 0;
+
+    bool direct = layer && layer->one_blob_only;
+#if NCNN_CNNCACHE
+    // a warm cache recomputes only the dirty pixels, which beats a full pass
+    if (direct && cache_mode && (!blob_mats_cached[layer_index].empty() || feature_epsilon[layer_index] > 0.f))
+        direct = false;
+#endif
+
+    if (!direct)
+    {
+        Mat in = Mat::from_pixels(pixels, type, w, h);
+        if (in.empty())
+            return -100;
+
+        if (mean_vals || norm_vals)
+            in.substract_mean_normalize(mean_vals, norm_vals);
+
+        return input(blob_index, in);
+    }
+
+    int top_blob_index = layer->tops[0];
+
+    Mat top_blob;
+    int ret = layer->forward_pixels(pixels, type, w, h, mean_vals, norm_vals, top_blob);
+    if (ret != 0)
+        return ret;
+
+    blob_mats[top_blob_index] = top_blob;
+
+#if NCNN_CNNCACHE
+    // the layer ran in full, its dirty rects still drive the layers after it
+    layer->forward_mrect(matched_rects[blob_index], matched_rects[top_blob_index]);
+#endif
+
+    return 0;
+}
+
 } // namespace ncnn
@@ -16,16 +16,22 @@
 #define NCNN_NET_H
 
 #include <stdio.h>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <vector>
 #include "blob.h"
 #include "layer.h"
 #include "mat.h"
 #include "platform.h"
 #include "mrect.h"
+#include "patchcache.h"
 
 namespace ncnn {
 
 class Extractor;
+class ThreadPool;
 class Net
 {
 public:
@@ -76,26 +82,148 @@ public:
     // unload network structure and weight data
     void clear();
 
+    // fold BatchNorm, Scale and Bias layers into the convolution before
+    // them and a following ReLU or PReLU into its output store, done by
+    // load_model, default off, set it before loading the model
+    // fused layers are removed, so layer indices given to the extractor
+    // shift and the blobs inside a fused chain can not be extracted any more
+    void set_layer_fusion(bool enable);
+
     // construct an Extractor from network
     Extractor create_extractor() const;
 
+    // extract_async requests of this net running at the same time
+    // further requests wait for one to finish, default 4
+    void set_async_depth(int depth);
+
+    // resolve the shape of every blob from the input blob shapes without
+    // running forward, inputs not given take the size declared in the param
+    // blobs whose shape depends on the data are left empty
+    // results are kept per input shape, the declared sizes are resolved at load
+    // return 0 if every blob was resolved
+    int infer_shape(const std::vector<int>& input_blob_indices, const std::vector<MatShape>& input_shapes,
+                    std::vector<MatShape>& blob_shapes) const;
+    int infer_shape(int input_blob_index, const MatShape& input_shape, std::vector<MatShape>& blob_shapes) const;
+#if NCNN_STRING
+    int infer_shape(const std::vector<const char*>& input_blob_names, const std::vector<MatShape>& input_shapes,
+                    std::vector<MatShape>& blob_shapes) const;
+    int infer_shape(const char* input_blob_name, const MatShape& input_shape, std::vector<MatShape>& blob_shapes) const;
+#endif // NCNN_STRING
+
 protected:
     friend class Extractor;
+    friend class Pipeline;
 #if NCNN_STRING
     int find_blob_index_by_name(const char* name) const;
     int find_layer_index_by_name(const char* name) const;
     int custom_layer_to_index(const char* type);
 #endif // NCNN_STRING
     Layer* create_custom_layer(int index);
-    int forward_layer(int layer_index, Extractor* extract) const;
+    // order the layers once after loading, extract then runs a flat loop
+    // over the part of the schedule the requested blobs depend on
+    // return 0 if success
+    int build_schedule();
+    int forward_blobs(const int* blob_indices, int count, Extractor* extractor) const;
+    // pack the activations of the extractor's last unplanned extract
+    // into one arena by blob lifetime over the schedule
+    int plan_memory(Extractor* extractor) const;
+    // run one pending layer and record its tops for plan_memory unless
+    // the extract is planned, ranges holds two pointers per bottom
+    int forward_scheduled(int layer_index, Extractor* extractor, const float** ranges, bool concurrent) const;
+    // run the pending layers up to schedule position last on the shared
+    // thread pool, each as soon as the producers of its bottoms are done
+    int forward_dataflow(int last, Extractor* extractor) const;
+    // run the layers the output depends on once per layer for a batch
+    int forward_batch(int input_blob_index, const std::vector<Mat>& inputs, int output_blob_index,
+                      std::vector<Mat>& feats, Extractor* extractor) const;
+    // run one layer whose bottoms are ready
+    // concurrent keeps it off the extractor scratch vectors
+    int forward_layer(int layer_index, Extractor* extractor, bool concurrent) const;
+    // one shape pass over the schedule, uncached
+    int resolve_shapes(const std::vector<int>& input_blob_indices, const std::vector<MatShape>& input_shapes,
+                       std::vector<MatShape>& blob_shapes) const;
+    // take a slot for an extract_async request, helping the pool while full
+    void begin_async(ThreadPool* pool) const;
+    void end_async() const;
+    // the fusion pass of load_model, rebuilds the schedule if a layer went
+    void fuse_layers();
 
 protected:
     std::vector<Blob> blobs;
     std::vector<Layer*> layers;
+    // layers in topological order and the position of each layer in it
+    std::vector<int> schedule;
+    std::vector<int> schedule_pos;
+
+    // infer_shape results by input shape, most recent last
+    struct ShapeCacheEntry
+    {
+        std::vector<int> input_blob_indices;
+        std::vector<MatShape> input_shapes;
+        std::vector<MatShape> blob_shapes;
+        int ret;
+    };
+    mutable std::vector<ShapeCacheEntry> shape_cache;
+    mutable std::mutex shape_cache_lock;
+
+    bool layer_fusion;
+
+    // extract_async requests running, at most async_depth
+    int async_depth;
+    mutable int async_pending;
+    mutable std::mutex async_lock;
+    mutable std::condition_variable async_cond;
 
     std::vector<layer_registry_entry> custom_layer_registry;
 };
 
+#if NCNN_CNNCACHE
+class CacheCommitter;
+// owns the background cache commit worker of an extractor
+// a copy waits for the pending commits of the source and starts without a worker
+class CacheCommitHandle
+{
+public:
+    CacheCommitHandle();
+    CacheCommitHandle(const CacheCommitHandle& rhs);
+    CacheCommitHandle& operator=(const CacheCommitHandle& rhs);
+    ~CacheCommitHandle();
+
+    void wait(int layer_index) const;
+    void wait_all() const;
+
+public:
+    CacheCommitter* committer;
+};
+#endif // NCNN_CNNCACHE
+
+// shape and buffer sharing of a blob as produced by an extract
+struct BlobUsage
+{
+    int dims;
+    int w;
+    int h;
+    int c;
+    // blob whose buffer this one points into, -1 if it has its own
+    int alias;
+};
+
+// activation arena of an extractor, see Extractor::plan_memory
+struct MemoryPlan
+{
+    // layers the plan was made for, by schedule position
+    std::vector<char> pending;
+    // per layer, the top is written over its dying bottom
+    std::vector<char> inplace;
+    // per blob, its data lives in the arena
+    std::vector<char> backed;
+    // per blob, the arena slot it is created in, empty if none
+    std::vector<Mat> views;
+    Mat arena;
+    bool lightmode;
+    bool cache_mode;
+};
+
 class Extractor
 {
 public:
@@ -105,10 +233,46 @@ public:
     void set_light_mode(bool enable);
 
     // set thread count for this extractor
-    // this will overwrite the global setting
-    // default count is system depended
+    // it applies to the calling thread during each extract only, so
+    // extractors on other threads keep their own counts
+    // default 0 takes an even share of the thread pool between the
+    // extracts running on it at the same time
     void set_num_threads(int num_threads);
 
+    // share a thread pool between extractors or give one its own
+    // the pool must outlive the extractor, null restores the shared pool
+    // branch parallel layers and extract_parallel frames run on it
+    void set_thread_pool(ThreadPool* pool);
+
+    // run the layers of independent branches concurrently on the shared
+    // thread pool, a layer gets the thread count split between the layers
+    // running when it starts, so one running alone keeps the whole team
+    // planned extracts stay sequential
+    // disabled by default
+    void set_branch_parallel(bool enable);
+
+    // enable streaming mode
+    // recurrent layers keep their hidden state across extract calls
+    // so each call only needs to feed the new timesteps
+    // disabled by default
+    void set_streaming(bool enable);
+
+    // time every layer of the following extracts into layer_times
+    // disabled by default
+    void set_profiling(bool enable);
+
+    // drop the recurrent state, the next extract starts from zero state
+    // return 0 if success
+    int reset_state();
+    int reset_state(int layer_index);
+
+    // save and roll back the recurrent state
+    // update_cnncache checkpoints it too in streaming mode, so restoring
+    // matches the state to the last committed cache
+    // return 0 if success
+    int checkpoint_state();
+    int restore_state();
+
 #if NCNN_STRING
     // set input by blob name
     // return 0 if success
@@ -127,25 +291,169 @@ public:
     // return 0 if success
     int extract(int blob_index, Mat& feat);
 
+    // get several results in one pass, layers they share run once
+    // return 0 if success
+    int extract(const std::vector<int>& blob_indices, std::vector<Mat>& feats);
+#if NCNN_STRING
+    int extract(const std::vector<const char*>& blob_names, std::vector<Mat>& feats);
+#endif // NCNN_STRING
+
+    // extract on the thread pool and return at once
+    // the callback gets the result on a pool thread, or inline on a pool
+    // without workers, the future version stores it into feat first, so
+    // feat must stay alive until then
+    // the extractor must not be used until the request completed
+    // requests beyond the net's async depth wait for a slot and help the
+    // pool with queued work meanwhile
+    // return 0 if the request was taken, the callback is not called otherwise
+#if NCNN_STRING
+    int extract_async(const char* blob_name, const std::function<void(int, const Mat&)>& callback);
+    std::future<int> extract_async(const char* blob_name, Mat& feat);
+#endif // NCNN_STRING
+    int extract_async(int blob_index, const std::function<void(int, const Mat&)>& callback);
+    std::future<int> extract_async(int blob_index, Mat& feat);
+
+    // run a batch of inputs through the layers the output depends on
+    // layer by layer, so every layer loads its weights once per batch
+    // instead of once per sample, one output per input
+    // other inputs already set are shared by the whole batch, the cnn
+    // cache and the recurrent state are not used
+    // return 0 if success
+    int extract_batch(int input_blob_index, const std::vector<Mat>& inputs, int output_blob_index, std::vector<Mat>& feats);
+#if NCNN_STRING
+    int extract_batch(const char* input_name, const std::vector<Mat>& inputs, const char* output_name, std::vector<Mat>& feats);
+#endif // NCNN_STRING
+
+    // set input from a blob of another extractor without copying
+    // the trunk computes the blob on demand and its dirty rects come along,
+    // so several heads can share one cached backbone per frame
+    // return 0 if success
+#if NCNN_STRING
+    int input_from(const char* blob_name, Extractor& trunk, const char* trunk_blob_name);
+#endif // NCNN_STRING
+    int input_from(int blob_index, Extractor& trunk, int trunk_blob_index);
+
+    // set input from interleaved 8-bit pixels, type as Mat::from_pixels
+    // mean_vals and norm_vals as Mat::substract_mean_normalize, either may be null
+    // when the blob feeds a single layer it consumes the pixels directly,
+    // a stride 2 stem convolution then never materializes the float input,
+    // in cache mode call input_mrect first
+    // return 0 if success
+#if NCNN_STRING
+    int input_pixels(const char* blob_name, const unsigned char* pixels, int type, int w, int h,
+                     const float* mean_vals, const float* norm_vals);
+#endif // NCNN_STRING
+    int input_pixels(int blob_index, const unsigned char* pixels, int type, int w, int h,
+                     const float* mean_vals, const float* norm_vals);
+
+    // plan one arena for the activations of the last extract
+    // later extracts running the same layers create every intermediate
+    // blob at a fixed offset in it, blobs never alive at the same time
+    // share memory and in place layers write over their bottom
+    // intermediate blobs are not kept after a planned extract, requested
+    // blobs and the ones the cnn cache snapshots keep their own buffers,
+    // so plan after setting up the cache, copies share the arena
+    // return 0 if success
+    int plan_memory();
+    void clear_memory_plan();
+    // arena bytes, the activation peak of a planned extract
+    size_t memory_plan_size() const;
+
+    // Net::infer_shape for the blobs set with input so far
+    // return 0 if every blob was resolved
+    int infer_shape(std::vector<MatShape>& blob_shapes) const;
+
     friend Extractor Net::create_extractor() const;
     Extractor(const Net* net, int blob_count);
     Extractor(){};
+    ~Extractor();
 
 public:
     const Net* net;
     std::vector<Mat> blob_mats;
     bool lightmode;
     int num_threads;
+    ThreadPool* thread_pool;
+    bool branch_parallel;
+    bool streaming;
+    // per layer milliseconds of its latest forward while profiling, empty otherwise
+    std::vector<double> layer_times;
+    // per layer recurrent state and its checkpoint
+    std::vector< std::vector<Mat> > layer_states;
+    std::vector< std::vector<Mat> > layer_states_checkpoint;
+    // schedule loop scratch sized once, pending flags by schedule position,
+    // consumers left per blob, and bottom/top vectors by blob count
+    std::vector<char> layer_pending;
+    std::vector<int> blob_refs;
+    std::vector< std::vector<Mat> > bottom_scratch;
+    std::vector< std::vector<Mat> > top_scratch;
+#if NCNN_CNNCACHE
+    std::vector< std::vector<MRect> > bottom_mrect_scratch;
+    std::vector< std::vector<MRect> > top_mrect_scratch;
+#endif // NCNN_CNNCACHE
+    // what the last unplanned extract ran and produced, input of plan_memory
+    std::vector<BlobUsage> blob_usage;
+    std::vector<char> usage_pending;
+    std::vector<int> usage_requested;
+    std::vector<const float*> usage_ranges;
+    bool usage_lightmode;
+    MemoryPlan memory_plan;
+    // the running extract follows memory_plan
+    bool memory_planned;
 #if NCNN_CNNCACHE
     bool cache_mode;
+    // declared before the cache so copies settle pending commits first
+    CacheCommitHandle commit_handle;
     std::vector<Mat> blob_mats_cached;
     std::vector<MRect> matched_rects;
-    int input_mrect(int blob_index, MRect& mrect);
-    int input_mrect(const char* blob_name, MRect& mrect);
+    int input_mrect(int blob_index, const MRect& mrect);
+    int input_mrect(const char* blob_name, const MRect& mrect);
     int update_cnncache();
+    // snapshot the cached layers on a background worker and return at once
+    // the next extract waits per layer, only when that layer's cache is needed
+    int update_cnncache_async();
+    // reuse the cache of a keyframe extractor of the same net
+    // the keyframe may commit again later, this extractor keeps the old snapshot
+    // return 0 if success
+    int share_cnncache(const Extractor& keyframe);
+    // run buffered frames concurrently, each reusing this extractor's cache
+    // as an immutable keyframe with its own mrect, one output per frame
+    // num_workers 0 uses one worker per core
+    // return 0 if success
+    int extract_parallel(int input_blob_index, const std::vector<Mat>& frames, const std::vector<MRect>& mrects,
+                         int output_blob_index, std::vector<Mat>& feats, int num_workers = 0);
+#if NCNN_STRING
+    int extract_parallel(const char* input_name, const std::vector<Mat>& frames, const std::vector<MRect>& mrects,
+                         const char* output_name, std::vector<Mat>& feats, int num_workers = 0);
+#endif // NCNN_STRING
     int clear_cnncache();
     int clear_blob_data();
     void set_cache_mode(bool mode) {cache_mode = mode;}
+    // per layer minimum match quality (PSNR in dB) for reusing a block
+    // matched blocks below it are recomputed, 0 reuses everything
+    std::vector<float> reuse_psnr;
+    int set_reuse_quality(int layer_index, float min_psnr);
+#if NCNN_STRING
+    int set_reuse_quality(const char* layer_name, float min_psnr);
+#endif // NCNN_STRING
+    // per layer feature-space dirty check, 0 disables it
+    // changed tiles whose input stays within eps (max-abs) of the cached
+    // input at the offset location are reused again
+    std::vector<float> feature_epsilon;
+    std::vector<Mat> blob_mats_input_cached;
+    int set_feature_epsilon(int layer_index, float eps);
+#if NCNN_STRING
+    int set_feature_epsilon(const char* layer_name, float eps);
+#endif // NCNN_STRING
+    // content-addressed store of output tiles for one sliding window layer
+    // dirty tiles whose input patch was seen in any earlier frame are pasted
+    // from it, tile is the output tile edge, capacity the tile count kept
+    PatchCache patch_cache;
+    int patch_cache_layer;
+    int set_patch_cache(int layer_index, int tile, int capacity);
+#if NCNN_STRING
+    int set_patch_cache(const char* layer_name, int tile, int capacity);
+#endif // NCNN_STRING
 #endif
 };
 
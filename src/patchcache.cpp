@@ -0,0 +1,364 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "patchcache.h"
+
+#if NCNN_CNNCACHE
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace ncnn {
+
+// channels are averaged in up to 8 groups, so swapped channels tell apart
+static int thumb_groups(int channels)
+{
+    return std::min(channels, 8);
+}
+
+// 8x8 cell means over [x0,x1]x[y0,y1], one thumbnail per channel group
+static void patch_thumbnail(const Mat& blob, int x0, int y0, int x1, int y1, float* cells)
+{
+    const int pw = x1 - x0 + 1;
+    const int ph = y1 - y0 + 1;
+    const int groups = thumb_groups(blob.c);
+
+    for (int g = 0; g < groups; g++)
+    {
+        const int q0 = blob.c * g / groups;
+        const int q1 = blob.c * (g + 1) / groups;
+        float* gcells = cells + g * 64;
+
+        for (int cy = 0; cy < 8; cy++)
+        {
+            const int ys = y0 + ph * cy / 8;
+            const int ye = std::max(ys + 1, y0 + ph * (cy + 1) / 8);
+            for (int cx = 0; cx < 8; cx++)
+            {
+                const int xs = x0 + pw * cx / 8;
+                const int xe = std::max(xs + 1, x0 + pw * (cx + 1) / 8);
+
+                float sum = 0.f;
+                for (int q = q0; q < q1; q++)
+                {
+                    const Mat m = blob.channel(q);
+                    for (int y = ys; y < ye; y++)
+                    {
+                        const float* ptr = m.row(y);
+                        for (int x = xs; x < xe; x++)
+                            sum += ptr[x];
+                    }
+                }
+
+                gcells[cy * 8 + cx] = sum / ((ye - ys) * (xe - xs) * (q1 - q0));
+            }
+        }
+    }
+}
+
+// average hash, one bit per cell above the thumbnail mean
+static uint64_t average_hash(const float* cells)
+{
+    float mean = 0.f;
+    for (int i = 0; i < 64; i++)
+        mean += cells[i];
+    mean /= 64;
+
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        if (cells[i] > mean)
+            hash |= (uint64_t)1 << i;
+    }
+
+    return hash;
+}
+
+PatchCache::PatchCache() : tile(8), capacity(0), thumb_tolerance(0.01f), hit_count(0), miss_count(0)
+{
+}
+
+PatchCache::PatchCache(const PatchCache& rhs)
+    : tile(rhs.tile), capacity(rhs.capacity), thumb_tolerance(rhs.thumb_tolerance),
+      hit_count(rhs.hit_count), miss_count(rhs.miss_count), entries(rhs.entries)
+{
+    rebuild_index();
+}
+
+PatchCache& PatchCache::operator=(const PatchCache& rhs)
+{
+    if (this == &rhs)
+        return *this;
+
+    tile = rhs.tile;
+    capacity = rhs.capacity;
+    thumb_tolerance = rhs.thumb_tolerance;
+    hit_count = rhs.hit_count;
+    miss_count = rhs.miss_count;
+    entries = rhs.entries;
+    rebuild_index();
+
+    return *this;
+}
+
+void PatchCache::configure(int _tile, int _capacity)
+{
+    tile = _tile;
+    capacity = _capacity;
+    clear();
+}
+
+void PatchCache::clear()
+{
+    entries.clear();
+    index.clear();
+    hit_count = 0;
+    miss_count = 0;
+}
+
+void PatchCache::rebuild_index()
+{
+    index.clear();
+    for (std::list<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        index[it->key] = it;
+    }
+}
+
+const PatchCache::Entry* PatchCache::find(uint64_t key, const float* thumb, int thumb_size, const int* padding, int w, int h)
+{
+    std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(key);
+    if (it == index.end())
+        return 0;
+
+    const Entry& e = *it->second;
+    if (e.feat.w != w || e.feat.h != h || (int)e.thumb.size() != thumb_size)
+        return 0;
+
+    // a tile computed against padding differs from one inside the image
+    if (memcmp(e.padding, padding, sizeof(e.padding)) != 0)
+        return 0;
+
+    // the hash alone collides on flat or periodic content
+    float level = 0.f;
+    for (int i = 0; i < thumb_size; i++)
+        level += fabs(e.thumb[i]);
+    const float tolerance = thumb_tolerance * level / thumb_size + 1e-6f;
+    for (int i = 0; i < thumb_size; i++)
+    {
+        if (fabs(e.thumb[i] - thumb[i]) > tolerance)
+            return 0;
+    }
+
+    // most recently used moves to the front
+    entries.splice(entries.begin(), entries, it->second);
+
+    return &entries.front();
+}
+
+void PatchCache::insert(uint64_t key, const float* thumb, int thumb_size, const int* padding, const Mat& feat)
+{
+    std::unordered_map<uint64_t, std::list<Entry>::iterator>::iterator it = index.find(key);
+    if (it != index.end())
+    {
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    Entry e;
+    e.key = key;
+    e.thumb.assign(thumb, thumb + thumb_size);
+    memcpy(e.padding, padding, sizeof(e.padding));
+    e.feat = feat;
+    entries.push_front(e);
+    index[key] = entries.begin();
+
+    while ((int)entries.size() > capacity)
+    {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
+
+int PatchCache::forward(const Layer* layer, const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob)
+{
+    int kernel_extent;
+    int stride;
+    int pad;
+    if (capacity <= 0 || tile <= 0 || !layer->input_window(kernel_extent, stride, pad))
+        return layer->forward_cached(bottom_blob, top_blob, mrect, cached_blob);
+
+    const int w = bottom_blob.w;
+    const int h = bottom_blob.h;
+    const int outw = (w + 2 * pad - kernel_extent) / stride + 1;
+    const int outh = (h + 2 * pad - kernel_extent) / stride + 1;
+    if (outw <= 0 || outh <= 0)
+        return layer->forward_cached(bottom_blob, top_blob, mrect, cached_blob);
+
+    // output tiles touched by the changed rects
+    const int tiles_x = (outw + tile - 1) / tile;
+    const int tiles_y = (outh + tile - 1) / tile;
+    std::vector<char> dirty(tiles_x * tiles_y, 0);
+    for (size_t i = 0; i < mrect.changed_vecs.size(); i++)
+    {
+        const struct rect& r = mrect.changed_vecs[i];
+        const int x1 = std::max(r.x1, 0);
+        const int y1 = std::max(r.y1, 0);
+        const int x2 = std::min(r.x2, outw - 1);
+        const int y2 = std::min(r.y2, outh - 1);
+        if (x1 > x2 || y1 > y2)
+            continue;
+
+        for (int ty = y1 / tile; ty <= y2 / tile; ty++)
+        {
+            for (int tx = x1 / tile; tx <= x2 / tile; tx++)
+                dirty[ty * tiles_x + tx] = 1;
+        }
+    }
+
+    // look up the input patch each dirty tile depends on
+    std::vector<int> hit_tiles;
+    std::vector<Mat> hit_feats;
+    std::vector<int> miss_tiles;
+    std::vector<uint64_t> miss_keys;
+    std::vector<float> miss_thumbs;
+    std::vector<int> miss_paddings;
+    const int thumb_size = thumb_groups(bottom_blob.c) * 64;
+    std::vector<float> thumb(thumb_size);
+    for (int t = 0; t < tiles_x * tiles_y; t++)
+    {
+        if (!dirty[t])
+            continue;
+
+        const int ox0 = (t % tiles_x) * tile;
+        const int oy0 = (t / tiles_x) * tile;
+        const int tw = std::min(tile, outw - ox0);
+        const int th = std::min(tile, outh - oy0);
+
+        // receptive field of the tile, clipped to the image
+        const int rx0 = ox0 * stride - pad;
+        const int ry0 = oy0 * stride - pad;
+        const int rx1 = (ox0 + tw - 1) * stride - pad + kernel_extent - 1;
+        const int ry1 = (oy0 + th - 1) * stride - pad + kernel_extent - 1;
+        const int ix0 = std::max(rx0, 0);
+        const int iy0 = std::max(ry0, 0);
+        const int ix1 = std::min(rx1, w - 1);
+        const int iy1 = std::min(ry1, h - 1);
+        const int padding[4] = {ix0 - rx0, iy0 - ry0, rx1 - ix1, ry1 - iy1};
+
+        patch_thumbnail(bottom_blob, ix0, iy0, ix1, iy1, &thumb[0]);
+        uint64_t key = 0;
+        for (int i = 0; i < thumb_size; i += 64)
+            key = key * 0x100000001B3ULL ^ average_hash(&thumb[i]);
+        key ^= (uint64_t)((tw << 16) | th) * 0x9E3779B97F4A7C15ULL;
+        key ^= ((uint64_t)padding[0] | (uint64_t)padding[1] << 16
+                | (uint64_t)padding[2] << 32 | (uint64_t)padding[3] << 48) * 0xC2B2AE3D27D4EB4FULL;
+
+        const Entry* e = find(key, &thumb[0], thumb_size, padding, tw, th);
+        if (e)
+        {
+            hit_tiles.push_back(t);
+            hit_feats.push_back(e->feat);
+        }
+        else
+        {
+            miss_tiles.push_back(t);
+            miss_keys.push_back(key);
+            miss_thumbs.insert(miss_thumbs.end(), thumb.begin(), thumb.end());
+            miss_paddings.insert(miss_paddings.end(), padding, padding + 4);
+        }
+    }
+
+    hit_count += hit_tiles.size();
+    miss_count += miss_tiles.size();
+
+    int ret;
+    if (hit_tiles.empty())
+    {
+        ret = layer->forward_cached(bottom_blob, top_blob, mrect, cached_blob);
+    }
+    else
+    {
+        // recompute the missed tiles only, merged into runs per tile row
+        MRect reduced;
+        reduced.copyFrom(mrect);
+        reduced.changed_vecs.clear();
+        for (size_t i = 0; i < miss_tiles.size(); )
+        {
+            const int t0 = miss_tiles[i];
+            size_t j = i + 1;
+            while (j < miss_tiles.size() && miss_tiles[j] == miss_tiles[j - 1] + 1 && miss_tiles[j] % tiles_x != 0)
+                j++;
+            const int t1 = miss_tiles[j - 1];
+
+            const int oy0 = (t0 / tiles_x) * tile;
+            reduced.add_rect((t0 % tiles_x) * tile, oy0,
+                             std::min((t1 % tiles_x + 1) * tile, outw) - 1, std::min(oy0 + tile, outh) - 1);
+            i = j;
+        }
+
+        ret = layer->forward_cached(bottom_blob, top_blob, reduced, cached_blob);
+    }
+    if (ret != 0)
+        return ret;
+
+    if (top_blob.w != outw || top_blob.h != outh)
+        return 0;
+
+    const int outc = top_blob.c;
+
+    for (size_t i = 0; i < hit_tiles.size(); i++)
+    {
+        const int ox0 = (hit_tiles[i] % tiles_x) * tile;
+        const int oy0 = (hit_tiles[i] / tiles_x) * tile;
+        const Mat& feat = hit_feats[i];
+        for (int q = 0; q < outc; q++)
+        {
+            Mat out = top_blob.channel(q);
+            const Mat m = feat.channel(q);
+            for (int y = 0; y < feat.h; y++)
+                memcpy(out.row(oy0 + y) + ox0, m.row(y), feat.w * sizeof(float));
+        }
+    }
+
+    for (size_t i = 0; i < miss_tiles.size(); i++)
+    {
+        const int ox0 = (miss_tiles[i] % tiles_x) * tile;
+        const int oy0 = (miss_tiles[i] / tiles_x) * tile;
+        const int tw = std::min(tile, outw - ox0);
+        const int th = std::min(tile, outh - oy0);
+
+        Mat feat(tw, th, outc);
+        if (feat.empty())
+            return -100;
+
+        for (int q = 0; q < outc; q++)
+        {
+            const Mat out = top_blob.channel(q);
+            Mat m = feat.channel(q);
+            for (int y = 0; y < th; y++)
+                memcpy(m.row(y), out.row(oy0 + y) + ox0, tw * sizeof(float));
+        }
+
+        insert(miss_keys[i], &miss_thumbs[i * thumb_size], thumb_size, &miss_paddings[i * 4], feat);
+    }
+
+    return 0;
+}
+
+} // namespace ncnn
+
+#endif // NCNN_CNNCACHE
@@ -0,0 +1,88 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_PATCHCACHE_H
+#define NCNN_PATCHCACHE_H
+
+#include "platform.h"
+
+#if NCNN_CNNCACHE
+
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include "layer.h"
+#include "mat.h"
+#include "mrect.h"
+
+namespace ncnn {
+
+// bounded LRU store of layer output tiles keyed by a perceptual hash of the
+// input patch they depend on, so scenes revisited after many frames can
+// pull their features instead of recomputing them
+class PatchCache
+{
+public:
+    PatchCache();
+    PatchCache(const PatchCache& rhs);
+    PatchCache& operator=(const PatchCache& rhs);
+
+    // tile is the output tile edge in pixels, capacity the entry count
+    // capacity 0 disables the store
+    void configure(int tile, int capacity);
+    void clear();
+
+    // cached forward of a sliding window layer
+    // dirty tiles whose input patch is known are pasted from the store,
+    // the others are recomputed and stored
+    int forward(const Layer* layer, const Mat& bottom_blob, Mat& top_blob, MRect& mrect, Mat& cached_blob);
+
+    int size() const { return (int)entries.size(); }
+
+public:
+    int tile;
+    int capacity;
+    // largest thumbnail cell difference accepted on a hash match,
+    // relative to the mean cell magnitude
+    float thumb_tolerance;
+
+    int hit_count;
+    int miss_count;
+
+protected:
+    struct Entry
+    {
+        uint64_t key;
+        // 8x8 cell means of the input patch per channel group
+        std::vector<float> thumb;
+        // zero padding the patch reaches into, left top right bottom
+        int padding[4];
+        Mat feat;
+    };
+
+    const Entry* find(uint64_t key, const float* thumb, int thumb_size, const int* padding, int w, int h);
+    void insert(uint64_t key, const float* thumb, int thumb_size, const int* padding, const Mat& feat);
+    void rebuild_index();
+
+    // most recent first
+    std::list<Entry> entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_CNNCACHE
+
+#endif // NCNN_PATCHCACHE_H
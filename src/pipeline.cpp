@@ -0,0 +1,427 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#include "pipeline.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "threadpool.h"
+
+namespace ncnn {
+
+// blobs crossing into a stage, in the order of its inputs
+struct PipelineFrame
+{
+    PipelineFrame() : ret(0) {}
+
+    std::vector<Mat> blobs;
+#if NCNN_CNNCACHE
+    std::vector<MRect> mrects;
+#endif // NCNN_CNNCACHE
+    // error of an earlier stage, later stages pass the frame on untouched
+    int ret;
+};
+
+// bounded handoff between two stages
+// closing drops the queued frames, wakes every waiter and fails later calls
+class PipelineQueue
+{
+public:
+    PipelineQueue(int _capacity) : capacity(_capacity), closed(false) {}
+
+    // wait for room, return false if closed
+    bool push(const PipelineFrame& frame)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&]{ return closed || (int)frames.size() < capacity; });
+        if (closed)
+            return false;
+
+        frames.push_back(frame);
+        cond.notify_all();
+        return true;
+    }
+
+    // wait for a frame, return false if closed
+    bool pop(PipelineFrame& frame)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [&]{ return closed || !frames.empty(); });
+        if (closed)
+            return false;
+
+        frame = frames.front();
+        frames.pop_front();
+        cond.notify_all();
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        frames.clear();
+        cond.notify_all();
+    }
+
+private:
+    int capacity;
+    bool closed;
+    std::deque<PipelineFrame> frames;
+    std::mutex lock;
+    std::condition_variable cond;
+};
+
+// one part of the schedule with the extractor and threads running it
+class PipelineStage
+{
+public:
+    PipelineStage(const Extractor& _extractor, int num_threads) : extractor(_extractor)
+    {
+        pool = new ThreadPool(num_threads - 1);
+        extractor.set_thread_pool(pool);
+        extractor.set_num_threads(num_threads);
+    }
+
+    ~PipelineStage()
+    {
+        if (worker.joinable())
+            worker.join();
+
+        delete pool;
+    }
+
+    void run(PipelineQueue* in, PipelineQueue* out);
+
+public:
+    Extractor extractor;
+    ThreadPool* pool;
+    // blobs received from the stage before and handed to the one after
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+    // per output, the input it passes through unchanged, -1 if computed here
+    std::vector<int> passthrough;
+    // the outputs computed here, extracted in one pass
+    std::vector<int> computed;
+#if NCNN_CNNCACHE
+    bool cache_mode;
+#endif // NCNN_CNNCACHE
+    std::thread worker;
+};
+
+void PipelineStage::run(PipelineQueue* in, PipelineQueue* out)
+{
+    // inputs the stage only consumes are released after feeding them, so
+    // in place layers in light mode need not copy them
+    std::vector<char> kept(inputs.size(), 0);
+    for (size_t i=0; i<passthrough.size(); i++)
+    {
+        if (passthrough[i] != -1)
+            kept[passthrough[i]] = 1;
+    }
+
+    PipelineFrame frame;
+    while (in->pop(frame))
+    {
+        PipelineFrame next;
+        next.ret = frame.ret;
+
+        if (next.ret == 0)
+        {
+            for (size_t i=0; i<inputs.size(); i++)
+            {
+                extractor.input(inputs[i], frame.blobs[i]);
+#if NCNN_CNNCACHE
+                if (cache_mode)
+                    extractor.input_mrect(inputs[i], frame.mrects[i]);
+#endif // NCNN_CNNCACHE
+                if (!kept[i])
+                    frame.blobs[i].release();
+            }
+
+            std::vector<Mat> feats;
+            if (!computed.empty())
+                next.ret = extractor.extract(computed, feats);
+
+            if (next.ret == 0)
+            {
+                next.blobs.resize(outputs.size());
+#if NCNN_CNNCACHE
+                next.mrects.resize(outputs.size());
+#endif // NCNN_CNNCACHE
+                for (size_t i=0, j=0; i<outputs.size(); i++)
+                {
+                    next.blobs[i] = passthrough[i] != -1 ? frame.blobs[passthrough[i]] : feats[j++];
+#if NCNN_CNNCACHE
+                    if (cache_mode)
+                        next.mrects[i] = extractor.matched_rects[outputs[i]];
+#endif // NCNN_CNNCACHE
+                }
+
+#if NCNN_CNNCACHE
+                if (cache_mode)
+                    extractor.update_cnncache();
+#endif // NCNN_CNNCACHE
+            }
+
+            for (size_t i=0; i<extractor.blob_mats.size(); i++)
+            {
+                extractor.blob_mats[i].release();
+            }
+        }
+
+        frame = PipelineFrame();
+        if (!out->push(next))
+            break;
+    }
+}
+
+Pipeline::Pipeline(const Net* _net, int _input_blob_index, int _output_blob_index, int _num_stages)
+    : net(_net), input_blob_index(_input_blob_index), output_blob_index(_output_blob_index), num_stages(_num_stages)
+{
+    lightmode = false;
+    num_threads = 0;
+    queue_depth = 2;
+#if NCNN_CNNCACHE
+    cache_mode = false;
+#endif // NCNN_CNNCACHE
+}
+
+#if NCNN_STRING
+Pipeline::Pipeline(const Net* _net, const char* input_name, const char* output_name, int _num_stages)
+    : net(_net), num_stages(_num_stages)
+{
+    input_blob_index = net->find_blob_index_by_name(input_name);
+    output_blob_index = net->find_blob_index_by_name(output_name);
+    lightmode = false;
+    num_threads = 0;
+    queue_depth = 2;
+#if NCNN_CNNCACHE
+    cache_mode = false;
+#endif // NCNN_CNNCACHE
+}
+#endif // NCNN_STRING
+
+Pipeline::~Pipeline()
+{
+    stop();
+}
+
+void Pipeline::set_light_mode(bool enable)
+{
+    lightmode = enable;
+}
+
+void Pipeline::set_num_threads(int _num_threads)
+{
+    num_threads = _num_threads;
+}
+
+void Pipeline::set_queue_depth(int depth)
+{
+    queue_depth = std::max(1, depth);
+}
+
+#if NCNN_CNNCACHE
+void Pipeline::set_cache_mode(bool mode)
+{
+    cache_mode = mode;
+}
+#endif // NCNN_CNNCACHE
+
+int Pipeline::start(const Mat& sample)
+{
+    if (!stages.empty() || num_stages < 1)
+        return -1;
+
+    if (input_blob_index < 0 || input_blob_index >= (int)net->blobs.size()
+        || output_blob_index < 0 || output_blob_index >= (int)net->blobs.size())
+        return -1;
+
+    // time the layers the output depends on
+    Extractor profiler = net->create_extractor();
+    profiler.set_light_mode(lightmode);
+    profiler.set_profiling(true);
+    profiler.input(input_blob_index, sample);
+
+    Mat feat;
+    int ret = profiler.extract(output_blob_index, feat);
+    if (ret != 0)
+        return ret;
+
+    std::vector<int> positions;
+    std::vector<double> costs;
+    double total = 0.0;
+    for (size_t p=0; p<profiler.usage_pending.size(); p++)
+    {
+        if (!profiler.usage_pending[p])
+            continue;
+
+        // a floor keeps layers too quick to time from collapsing stages
+        double cost = profiler.layer_times[net->schedule[p]] + 0.001;
+        positions.push_back((int)p);
+        costs.push_back(cost);
+        total += cost;
+    }
+
+    if (positions.empty())
+        return -1;
+
+    // first schedule position of every stage, a stage starts at the layer
+    // whose middle passes its share of the cost, and no stage is left empty
+    const int count = std::min(num_stages, (int)positions.size());
+    std::vector<int> first(count + 1);
+    first[0] = 0;
+    first[count] = positions.back() + 1;
+    double acc = 0.0;
+    for (int i=0, k=1; i<(int)positions.size() && k<count; i++)
+    {
+        int left = (int)positions.size() - i;
+        if (i > 0 && (acc + costs[i] / 2 >= total * k / count || left == count - k))
+            first[k++] = positions[i];
+
+        acc += costs[i];
+    }
+
+    // blobs produced before cut k and consumed at or after it
+    std::vector< std::vector<int> > live(count + 1);
+    live[0].push_back(input_blob_index);
+    live[count].push_back(output_blob_index);
+    for (size_t i=0; i<positions.size(); i++)
+    {
+        const Layer* layer = net->layers[net->schedule[positions[i]]];
+        for (size_t j=0; j<layer->bottoms.size(); j++)
+        {
+            int blob_index = layer->bottoms[j];
+            int producer = net->blobs[blob_index].producer;
+            int produced = (blob_index == input_blob_index || producer == -1) ? -1 : net->schedule_pos[producer];
+            for (int k=1; k<count; k++)
+            {
+                if (produced < first[k] && first[k] <= positions[i]
+                    && std::find(live[k].begin(), live[k].end(), blob_index) == live[k].end())
+                    live[k].push_back(blob_index);
+            }
+        }
+    }
+
+    const int stage_threads = num_threads ? num_threads : std::max(1, ThreadPool::shared()->concurrency() / count);
+    for (int k=0; k<count; k++)
+    {
+        Extractor extractor = net->create_extractor();
+        extractor.set_light_mode(lightmode);
+        PipelineStage* stage = new PipelineStage(extractor, stage_threads);
+        stage->inputs = live[k];
+        stage->outputs = live[k + 1];
+        for (size_t i=0; i<stage->outputs.size(); i++)
+        {
+            std::vector<int>::const_iterator it = std::find(stage->inputs.begin(), stage->inputs.end(), stage->outputs[i]);
+            stage->passthrough.push_back(it == stage->inputs.end() ? -1 : (int)(it - stage->inputs.begin()));
+            if (it == stage->inputs.end())
+                stage->computed.push_back(stage->outputs[i]);
+        }
+#if NCNN_CNNCACHE
+        stage->cache_mode = cache_mode;
+        stage->extractor.set_cache_mode(cache_mode);
+#endif // NCNN_CNNCACHE
+        stages.push_back(stage);
+    }
+
+    for (int k=0; k<=count; k++)
+    {
+        queues.push_back(new PipelineQueue(queue_depth));
+    }
+
+    for (int k=0; k<count; k++)
+    {
+        stages[k]->worker = std::thread(&PipelineStage::run, stages[k], queues[k], queues[k + 1]);
+    }
+
+    return 0;
+}
+
+int Pipeline::stage_count() const
+{
+    return (int)stages.size();
+}
+
+int Pipeline::push(const Mat& in)
+{
+    if (queues.empty())
+        return -1;
+
+    PipelineFrame frame;
+    frame.blobs.push_back(in);
+#if NCNN_CNNCACHE
+    // an empty mrect reads as unchanged, a frame without one is new throughout
+    frame.mrects.resize(1);
+    frame.mrects[0].add_rect(0, 0, MRECT_FULL, MRECT_FULL);
+#endif // NCNN_CNNCACHE
+
+    return queues[0]->push(frame) ? 0 : -1;
+}
+
+#if NCNN_CNNCACHE
+int Pipeline::push(const Mat& in, const MRect& mrect)
+{
+    if (queues.empty())
+        return -1;
+
+    PipelineFrame frame;
+    frame.blobs.push_back(in);
+    frame.mrects.push_back(mrect);
+
+    return queues[0]->push(frame) ? 0 : -1;
+}
+#endif // NCNN_CNNCACHE
+
+int Pipeline::pop(Mat& feat)
+{
+    if (queues.empty())
+        return -1;
+
+    PipelineFrame frame;
+    if (!queues.back()->pop(frame))
+        return -1;
+
+    if (frame.ret != 0)
+        return frame.ret;
+
+    feat = frame.blobs[0];
+    return 0;
+}
+
+void Pipeline::stop()
+{
+    for (size_t i=0; i<queues.size(); i++)
+    {
+        queues[i]->close();
+    }
+
+    for (size_t i=0; i<stages.size(); i++)
+    {
+        delete stages[i];
+    }
+    stages.clear();
+
+    for (size_t i=0; i<queues.size(); i++)
+    {
+        delete queues[i];
+    }
+    queues.clear();
+}
+
+} // namespace ncnn
@@ -0,0 +1,100 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+#ifndef NCNN_PIPELINE_H
+#define NCNN_PIPELINE_H
+
+#include <vector>
+#include "net.h"
+
+namespace ncnn {
+
+class PipelineQueue;
+class PipelineStage;
+
+// runs a stream of frames through a net in stages for throughput
+// every stage owns a contiguous part of the layer schedule, an extractor
+// holding the cnn cache of those layers and a thread pool of its own, so
+// it works on frame t while the stage before it works on frame t+1
+// bounded queues sit between the stages, frames come out in push order
+class Pipeline
+{
+public:
+    Pipeline(const Net* net, int input_blob_index, int output_blob_index, int num_stages);
+#if NCNN_STRING
+    Pipeline(const Net* net, const char* input_name, const char* output_name, int num_stages);
+#endif // NCNN_STRING
+    // drops the frames still in flight
+    ~Pipeline();
+
+    // settings of the stage extractors, applied by start
+    void set_light_mode(bool enable);
+    // threads per stage, default 0 splits the cores evenly between stages
+    void set_num_threads(int num_threads);
+    // frames a queue between two stages holds before the producer waits
+    // default 2
+    void set_queue_depth(int depth);
+#if NCNN_CNNCACHE
+    // each stage reuses the cache of its own layers and commits it after
+    // every frame, so the mrect of a frame is relative to the one before
+    void set_cache_mode(bool mode);
+#endif // NCNN_CNNCACHE
+
+    // time one extract of sample to cut the schedule into stages of about
+    // equal cost, fewer stages if the net has fewer layers, then start them
+    // return 0 if success
+    int start(const Mat& sample);
+
+    // number of stages running, 0 before start
+    int stage_count() const;
+
+    // hand in the next frame, blocks while the first stage is behind
+    // return 0 if success
+    int push(const Mat& in);
+#if NCNN_CNNCACHE
+    // in cache mode frames need the mrect of their change to reuse the
+    // cache, a frame pushed without one is recomputed in full
+    int push(const Mat& in, const MRect& mrect);
+#endif // NCNN_CNNCACHE
+
+    // take the output of the oldest frame not taken yet
+    // blocks until it is ready, so every pop needs an earlier push
+    // return 0 if success, the error of the failing stage otherwise
+    int pop(Mat& feat);
+
+private:
+    Pipeline(const Pipeline&);
+    Pipeline& operator=(const Pipeline&);
+
+    void stop();
+
+    const Net* net;
+    int input_blob_index;
+    int output_blob_index;
+    int num_stages;
+    bool lightmode;
+    int num_threads;
+    int queue_depth;
+#if NCNN_CNNCACHE
+    bool cache_mode;
+#endif // NCNN_CNNCACHE
+
+    // queues[s] feeds stage s, the last one holds the outputs
+    std::vector<PipelineQueue*> queues;
+    std::vector<PipelineStage*> stages;
+};
+
+} // namespace ncnn
+
+#endif // NCNN_PIPELINE_H
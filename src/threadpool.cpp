@@ -0,0 +1,346 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+
+#include "threadpool.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+
+namespace ncnn {
+
+ThreadPool::ThreadPool(int num_threads) : stop(false), users(0)
+{
+    for (int i=0; i<num_threads; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::work, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stop = true;
+    }
+    task_cond.notify_all();
+    for (size_t i=0; i<workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::enqueue(const std::function<void()>& task)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(task);
+    }
+    task_cond.notify_one();
+}
+
+bool ThreadPool::run_one()
+{
+    std::function<void()> task;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (tasks.empty())
+            return false;
+        task = tasks.front();
+        tasks.pop_front();
+    }
+
+    task();
+    return true;
+}
+
+void ThreadPool::run(int count, const std::function<void(int)>& task)
+{
+    if (count <= 0)
+        return;
+
+    // every runner takes the next index until none is left
+    std::atomic<int> next(0);
+    std::mutex done_lock;
+    std::condition_variable done_cond;
+    int runners = std::min(count, (int)workers.size() + 1) - 1;
+
+    for (int i=0; i<runners; i++)
+    {
+        enqueue([&]() {
+            for (int j = next++; j < count; j = next++)
+            {
+                task(j);
+            }
+
+            std::lock_guard<std::mutex> guard(done_lock);
+            runners--;
+            done_cond.notify_all();
+        });
+    }
+
+    for (int j = next++; j < count; j = next++)
+    {
+        task(j);
+    }
+
+    // the runners still queued reference this frame, help them through
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> guard(done_lock);
+            if (runners == 0)
+                break;
+        }
+
+        if (!run_one())
+        {
+            std::unique_lock<std::mutex> guard(done_lock);
+            done_cond.wait(guard, [&]{ return runners == 0; });
+            break;
+        }
+    }
+}
+
+int ThreadPool::enter()
+{
+    int count = ++users;
+    return std::max(1, concurrency() / count);
+}
+
+void ThreadPool::leave()
+{
+    --users;
+}
+
+ThreadPool* ThreadPool::shared()
+{
+    static ThreadPool pool(std::max(0, (int)std::thread::hardware_concurrency() - 1));
+    return &pool;
+}
+
+void ThreadPool::work()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            task_cond.wait(guard, [&]{ return stop || !tasks.empty(); });
+            // queued tasks are drained before stopping
+            if (tasks.empty())
+                return;
+            task = tasks.front();
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+static thread_local ThreadPool* parallel_pool = 0;
+static thread_local int parallel_threads = 0;
+
+ParallelScope::ParallelScope(ThreadPool* pool, int num_threads)
+{
+    pool_saved = parallel_pool;
+    num_threads_saved = parallel_threads;
+    parallel_pool = pool;
+    parallel_threads = num_threads;
+}
+
+ParallelScope::~ParallelScope()
+{
+    parallel_pool = pool_saved;
+    parallel_threads = num_threads_saved;
+}
+
+ThreadPool* ParallelScope::current_pool()
+{
+    return parallel_pool ? parallel_pool : ThreadPool::shared();
+}
+
+int ParallelScope::current_threads()
+{
+    return parallel_pool ? parallel_threads : ThreadPool::shared()->concurrency();
+}
+
+namespace {
+
+// the part of a parallel_for range one thread owns
+// next and end are packed into one word so the owner taking from the front
+// and a thief cutting the back never race
+struct ParallelSlice
+{
+    std::atomic<uint64_t> range;
+    char padding[64 - sizeof(std::atomic<uint64_t>)];
+};
+
+// shared with the helpers, which may be dequeued after the loop returned
+struct ParallelLoop
+{
+    ParallelLoop(int count) : slices(count) {}
+
+    std::vector<ParallelSlice> slices;
+    std::atomic<int> remaining;
+    std::mutex lock;
+    std::condition_variable cond;
+    const std::function<void(int)>* func;
+    int begin;
+    int grain;
+};
+
+} // namespace
+
+static inline uint64_t pack_range(int next, int end)
+{
+    return (uint64_t)(uint32_t)next | ((uint64_t)(uint32_t)end << 32);
+}
+
+static inline int range_next(uint64_t range)
+{
+    return (int)(uint32_t)range;
+}
+
+static inline int range_end(uint64_t range)
+{
+    return (int)(uint32_t)(range >> 32);
+}
+
+// take up to grain iterations from the front of a slice
+static bool take_front(ParallelSlice& slice, int grain, int& next, int& end)
+{
+    uint64_t range = slice.range.load();
+    for (;;)
+    {
+        next = range_next(range);
+        int last = range_end(range);
+        if (next >= last)
+            return false;
+
+        end = std::min(next + grain, last);
+        if (slice.range.compare_exchange_weak(range, pack_range(end, last)))
+            return true;
+    }
+}
+
+// move the back half of the largest other slice into the empty own slice
+static bool steal_back(ParallelLoop& loop, int self)
+{
+    const int count = (int)loop.slices.size();
+    for (;;)
+    {
+        int victim = -1;
+        uint64_t victim_range = 0;
+        int most = 0;
+        for (int i=0; i<count; i++)
+        {
+            if (i == self)
+                continue;
+
+            uint64_t range = loop.slices[i].range.load();
+            int left = range_end(range) - range_next(range);
+            if (left > most)
+            {
+                most = left;
+                victim = i;
+                victim_range = range;
+            }
+        }
+
+        if (victim == -1)
+            return false;
+
+        int next = range_next(victim_range);
+        int end = range_end(victim_range);
+        int middle = next + (end - next) / 2;
+        if (loop.slices[victim].range.compare_exchange_strong(victim_range, pack_range(next, middle)))
+        {
+            loop.slices[self].range.store(pack_range(middle, end));
+            return true;
+        }
+    }
+}
+
+static void parallel_run(ParallelLoop& loop, int self)
+{
+    // nested loops run inline instead of oversubscribing the pool
+    ParallelScope scope(ParallelScope::current_pool(), 1);
+
+    do
+    {
+        int next;
+        int end;
+        while (take_front(loop.slices[self], loop.grain, next, end))
+        {
+            for (int i=next; i<end; i++)
+            {
+                (*loop.func)(loop.begin + i);
+            }
+
+            if ((loop.remaining -= end - next) == 0)
+            {
+                std::lock_guard<std::mutex> guard(loop.lock);
+                loop.cond.notify_all();
+            }
+        }
+    }
+    while (steal_back(loop, self));
+}
+
+void parallel_for(int begin, int end, const std::function<void(int)>& func)
+{
+    const int count = end - begin;
+    if (count <= 0)
+        return;
+
+    ThreadPool* pool = ParallelScope::current_pool();
+    const int num_threads = std::min(std::min(ParallelScope::current_threads(), pool->concurrency()), count);
+    if (num_threads <= 1)
+    {
+        for (int i=begin; i<end; i++)
+        {
+            func(i);
+        }
+        return;
+    }
+
+    std::shared_ptr<ParallelLoop> loop = std::make_shared<ParallelLoop>(num_threads);
+    loop->remaining.store(count);
+    loop->func = &func;
+    loop->begin = begin;
+    // a few chunks per slice, stealing evens out the rest
+    loop->grain = std::max(1, count / (num_threads * 4));
+    for (int i=0; i<num_threads; i++)
+    {
+        loop->slices[i].range.store(pack_range(count * i / num_threads, count * (i + 1) / num_threads));
+    }
+
+    // a helper that starts late finds its slice stolen and returns at once
+    for (int i=1; i<num_threads; i++)
+    {
+        pool->enqueue([loop, i]() {
+            parallel_run(*loop, i);
+        });
+    }
+
+    parallel_run(*loop, 0);
+
+    // the iterations other threads took are still running
+    std::unique_lock<std::mutex> guard(loop->lock);
+    loop->cond.wait(guard, [&]{ return loop->remaining.load() == 0; });
+}
+
+} // namespace ncnn
@@ -0,0 +1,109 @@
+// Tencent is pleased to support the open source community by making ncnn available.
+//
+// Copyright (C) 2017 THL A29 Limited, a Tencent company. All rights reserved.
+//
+// Licensed under the BSD 3-Clause License (the "License"); you may not use this file except
+// in compliance with the License. You may obtain a copy of the License at
+//
+// https://opensource.org/licenses/BSD-3-Clause
+//
+// Unless required by applicable law or agreed to in writing, software distributed
+// under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+// CONDITIONS OF ANY KIND, either express or implied. See the License for the
+// specific language governing permissions and limitations under the License.
+
+
+#ifndef NCNN_THREADPOOL_H
+#define NCNN_THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ncnn {
+
+// fixed set of worker threads running queued tasks in order
+// threads waiting on their own tasks call run_one to help instead of
+// blocking, so nested use never starves the pool
+// extractors share the process wide pool unless given their own, and
+// split its threads between the extracts running at the same time
+class ThreadPool
+{
+public:
+    // num_threads 0 runs nothing by itself, tasks wait for run_one
+    ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    void enqueue(const std::function<void()>& task);
+
+    // run one queued task on the calling thread
+    // return false if the queue was empty
+    bool run_one();
+
+    // run task(0) .. task(count - 1) on the workers and the calling thread
+    // and return when all of them are done
+    void run(int count, const std::function<void(int)>& task);
+
+    int size() const { return (int)workers.size(); }
+
+    // threads the pool spreads work over, the workers and one caller
+    int concurrency() const { return (int)workers.size() + 1; }
+
+    // a caller registers while it runs work on the pool's threads
+    // return its fair share of concurrency among the registered callers
+    int enter();
+    void leave();
+
+    // process wide pool, one worker per core besides the calling thread
+    static ThreadPool* shared();
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void work();
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable task_cond;
+    std::deque< std::function<void()> > tasks;
+    bool stop;
+    std::atomic<int> users;
+};
+
+// pool and thread count parallel_for uses on the calling thread
+// an extract sets them for its length, a layer running beside others
+// narrows the count to its share, outside any scope the shared pool
+// runs loops with all its threads
+class ParallelScope
+{
+public:
+    ParallelScope(ThreadPool* pool, int num_threads);
+    ~ParallelScope();
+
+    static ThreadPool* current_pool();
+    static int current_threads();
+
+private:
+    ParallelScope(const ParallelScope&);
+    ParallelScope& operator=(const ParallelScope&);
+
+    ThreadPool* pool_saved;
+    int num_threads_saved;
+};
+
+// run func(i) for i in [begin, end) on the current pool and thread count
+// every thread starts on its own slice of the range and takes small chunks
+// from its front, a thread out of work steals the back half of the largest
+// slice left, so uneven iterations and late or busy workers balance out
+// iterations may run in any order and on any thread
+// calls nested inside an iteration run inline on that thread
+void parallel_for(int begin, int end, const std::function<void(int)>& func);
+
+} // namespace ncnn
+
+#endif // NCNN_THREADPOOL_H